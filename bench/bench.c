@@ -0,0 +1,678 @@
+/************************************************************************
+*
+* Copyright 2026 by Sean Conner.  All Rights Reserved.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*
+* Comments, questions and criticisms can be sent to: sean@conman.org
+*
+*************************************************************************/
+
+/*************************************************************************
+*
+* Benchmark the blog engine.  This first builds a synthetic journal (using
+* the same YYYY/MM/DD/N layout, meta files and sidecar files as a real
+* one), then runs the program through its command line paths a number of
+* times each, reporting latency percentiles along with the number of files
+* opened and stat()ed (as reported by the program's --stats option).
+*
+* The random number generator is seeded with a fixed value (which can be
+* changed) so runs are repeatable.
+*
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <assert.h>
+
+#include <getopt.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+struct options
+{
+  char const *program;
+  char const *templates;
+  char const *dir;
+  int         years;
+  int         posts;
+  size_t      body;
+  int         comments;         /* percent of entries with comments    */
+  int         webmentions;      /* percent of entries with webmentions */
+  size_t      runs;
+  unsigned    seed;
+};
+
+struct sample
+{
+  double        msec;
+  unsigned long opens;
+  unsigned long stats;
+};
+
+/*************************************************************************/
+
+static bool write_file(char const *name,char const *data,size_t size)
+{
+  FILE *fp;
+  
+  assert(name != NULL);
+  assert(data != NULL);
+  
+  fp = fopen(name,"w");
+  if (fp == NULL)
+  {
+    fprintf(stderr,"%s: %s\n",name,strerror(errno));
+    return false;
+  }
+  
+  fwrite(data,1,size,fp);
+  fclose(fp);
+  return true;
+}
+
+/*************************************************************************/
+
+static char *make_text(size_t size)
+{
+  static char const words[][8] =
+  {
+    "the" , "quick" , "brown" , "fox" , "jumps" , "over" , "lazy" , "dog" ,
+    "lorem" , "ipsum" , "dolor" , "sit" , "amet" , "blog" , "entry" , "code"
+  };
+  
+  char   *text = malloc(size + 1);
+  size_t  len  = 0;
+  
+  if (text == NULL)
+    return NULL;
+    
+  /*-----------------------------------------------------------------------
+  ; Paragraphs of words with the odd link thrown in, so the HTML parser and
+  ; the link fixup code have something to chew on.
+  ;------------------------------------------------------------------------*/
+  
+  while(len < size)
+  {
+    char   buf[64];
+    int    r = rand();
+    size_t n;
+    
+    if (r % 97 == 0)
+      n = snprintf(buf,sizeof(buf),"<a href=\"/2011/11/28.1\">%s</a> ",words[r % 16]);
+    else if (r % 31 == 0)
+      n = snprintf(buf,sizeof(buf),"</p>\n\n<p>");
+    else
+      n = snprintf(buf,sizeof(buf),"%s ",words[r % 16]);
+      
+    if (len + n > size)
+      n = size - len;
+    memcpy(&text[len],buf,n);
+    len += n;
+  }
+  
+  text[len] = '\0';
+  return text;
+}
+
+/*************************************************************************/
+
+static bool make_day(struct options const *opt,int year,int month,int day)
+{
+  char  path[PATH_MAX];
+  FILE *titles;
+  FILE *class;
+  FILE *authors;
+  FILE *status;
+  bool  okay = true;
+  
+  assert(opt != NULL);
+  
+  snprintf(path,sizeof(path),"%04d",year);
+  mkdir(path,0777);
+  snprintf(path,sizeof(path),"%04d/%02d",year,month);
+  mkdir(path,0777);
+  snprintf(path,sizeof(path),"%04d/%02d/%02d",year,month,day);
+  if ((mkdir(path,0777) != 0) && (errno != EEXIST))
+  {
+    fprintf(stderr,"%s: %s\n",path,strerror(errno));
+    return false;
+  }
+  
+  snprintf(path,sizeof(path),"%04d/%02d/%02d/titles",year,month,day);
+  titles = fopen(path,"w");
+  snprintf(path,sizeof(path),"%04d/%02d/%02d/class",year,month,day);
+  class = fopen(path,"w");
+  snprintf(path,sizeof(path),"%04d/%02d/%02d/authors",year,month,day);
+  authors = fopen(path,"w");
+  snprintf(path,sizeof(path),"%04d/%02d/%02d/status",year,month,day);
+  status = fopen(path,"w");
+  
+  if ((titles == NULL) || (class == NULL) || (authors == NULL) || (status == NULL))
+  {
+    fprintf(stderr,"%04d/%02d/%02d: %s\n",year,month,day,strerror(errno));
+    okay = false;
+  }
+  
+  for (int part = 1 ; okay && (part <= opt->posts) ; part++)
+  {
+    char *text = make_text(opt->body);
+    
+    if (text == NULL)
+    {
+      okay = false;
+      break;
+    }
+    
+    snprintf(path,sizeof(path),"%04d/%02d/%02d/%d",year,month,day,part);
+    write_file(path,text,strlen(text));
+    free(text);
+    
+    fprintf(titles,"Entry %d for %04d/%02d/%02d\n",part,year,month,day);
+    fprintf(class,"%s\n",(rand() % 2) ? "programming, C" : "rants, random stuff");
+    fprintf(authors,"Joe Blog\n");
+    fprintf(status,"\n");
+    
+    if (rand() % 100 < opt->comments)
+    {
+      text = make_text(opt->body / 4);
+      snprintf(path,sizeof(path),"%04d/%02d/%02d/%d.comments",year,month,day,part);
+      write_file(path,text,strlen(text));
+      free(text);
+    }
+    
+    if (rand() % 100 < opt->webmentions)
+    {
+      char wm[BUFSIZ];
+      int  len = 0;
+      
+      for (int i = rand() % 5 + 1 ; i > 0 ; i--)
+        len += snprintf(&wm[len],sizeof(wm) - len,"https://example.net/%d\tA reply %d\n",rand(),i);
+      snprintf(path,sizeof(path),"%04d/%02d/%02d/%d.webmention",year,month,day,part);
+      write_file(path,wm,len);
+    }
+  }
+  
+  if (titles  != NULL) fclose(titles);
+  if (class   != NULL) fclose(class);
+  if (authors != NULL) fclose(authors);
+  if (status  != NULL) fclose(status);
+  return okay;
+}
+
+/*************************************************************************/
+
+static int remove_entry(char const *path,struct stat const *status,int flag,struct FTW *ftw)
+{
+  (void)status;
+  (void)flag;
+  (void)ftw;
+  
+  if (remove(path) != 0)
+    fprintf(stderr,"%s: %s\n",path,strerror(errno));
+  return 0;
+}
+
+/*************************************************************************/
+
+static void remove_tree(char const *dir)
+{
+  assert(dir != NULL);
+  
+  /*----------------------------------------------------------------------
+  ; Depth first, so each directory is empty by the time it's removed.
+  ;-----------------------------------------------------------------------*/
+  
+  if (chdir("/") < 0)
+    fprintf(stderr,"/: %s\n",strerror(errno));
+  if (nftw(dir,remove_entry,16,FTW_DEPTH | FTW_PHYS) != 0)
+    fprintf(stderr,"%s: %s\n",dir,strerror(errno));
+}
+
+/*************************************************************************/
+
+static int max_monthday(int year,int month)
+{
+  static int const days[] = { 31,28,31,30,31,30,31,31,30,31,30,31 };
+  
+  if ((month == 2) && (((year % 4 == 0) && (year % 100 != 0)) || (year % 400 == 0)))
+    return 29;
+  return days[month - 1];
+}
+
+/*************************************************************************/
+
+static bool make_journal(struct options const *opt,int *pfirst,int *plast)
+{
+  time_t     now = time(NULL);
+  struct tm *tm  = localtime(&now);
+  int        last;
+  int        first;
+  char       buf[BUFSIZ];
+  int        len;
+  
+  assert(opt    != NULL);
+  assert(pfirst != NULL);
+  assert(plast  != NULL);
+  
+  /*-----------------------------------------------------------------------
+  ; The archive runs up to yesterday, so --today and --thisday have
+  ; something to find.
+  ;------------------------------------------------------------------------*/
+  
+  last  = tm->tm_year + 1900;
+  first = last - opt->years + 1;
+  
+  for (int year = first ; year <= last ; year++)
+    for (int month = 1 ; month <= 12 ; month++)
+      for (int day = 1 ; day <= max_monthday(year,month) ; day++)
+      {
+        if ((year == last) && ((month > tm->tm_mon + 1) || ((month == tm->tm_mon + 1) && (day >= tm->tm_mday))))
+          break;
+        if (!make_day(opt,year,month,day))
+          return false;
+      }
+      
+  len = snprintf(buf,sizeof(buf),"%04d/01/01.1\n",first);
+  write_file(".first",buf,len);
+  
+  now -= 86400;
+  tm   = localtime(&now);
+  len  = snprintf(buf,sizeof(buf),"%04d/%02d/%02d.%d\n",tm->tm_year + 1900,tm->tm_mon + 1,tm->tm_mday,opt->posts);
+  write_file(".last",buf,len);
+  
+  /*-----------------------------------------------------------------------
+  ; And a configuration to go with it, using the sample templates.
+  ;------------------------------------------------------------------------*/
+  
+  len = snprintf(
+          buf,
+          sizeof(buf),
+          "name     = \"Benchmark\"\n"
+          "basedir  = \"%s\"\n"
+          "webdir   = \"%s\"\n"
+          "lockfile = \"%s/.lock\"\n"
+          "url      = \"http://www.example.com/blog/\"\n"
+          "author   = { name = \"Joe Blog\" , email = \"joe@example.com\" }\n"
+          "templates =\n"
+          "{\n"
+          "  { template = \"%s/html\" , output = \"%s/index.html\" , items = \"7d\" , reverse = true },\n"
+          "  { template = \"%s/rss\"  , output = \"%s/index.rss\"  , items = 15 , reverse = true },\n"
+          "  { template = \"%s/atom\" , output = \"%s/index.atom\" , items = 15 , reverse = true },\n"
+          "  { template = \"%s/json\" , output = \"%s/index.json\" , items = 15 , reverse = true },\n"
+          "}\n",
+          opt->dir,
+          opt->dir,
+          opt->dir,
+          opt->templates,opt->dir,
+          opt->templates,opt->dir,
+          opt->templates,opt->dir,
+          opt->templates,opt->dir
+        );
+  write_file("blog.conf",buf,len);
+  
+  *pfirst = first;
+  *plast  = last;
+  return true;
+}
+
+/*************************************************************************/
+
+static bool run(struct options const *opt,char *argv[],struct sample *sample)
+{
+  struct timespec start;
+  struct timespec end;
+  int             fds[2];
+  pid_t           child;
+  FILE           *in;
+  char            line[BUFSIZ];
+  int             status;
+  
+  assert(opt    != NULL);
+  assert(argv   != NULL);
+  assert(sample != NULL);
+  
+  if (pipe(fds) < 0)
+    return false;
+    
+  clock_gettime(CLOCK_MONOTONIC,&start);
+  
+  child = fork();
+  if (child == -1)
+  {
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+  else if (child == 0)
+  {
+    int devnull = open("/dev/null",O_RDWR);
+    
+    dup2(devnull,STDIN_FILENO);
+    dup2(devnull,STDOUT_FILENO);
+    dup2(fds[1],STDERR_FILENO);
+    close(devnull);
+    close(fds[0]);
+    close(fds[1]);
+    execv(opt->program,argv);
+    _Exit(127);
+  }
+  
+  close(fds[1]);
+  sample->opens = 0;
+  sample->stats = 0;
+  
+  /*-----------------------------------------------------------------------
+  ; The --stats output from the program comes through stderr.
+  ;------------------------------------------------------------------------*/
+  
+  in = fdopen(fds[0],"r");
+  while(fgets(line,sizeof(line),in) != NULL)
+  {
+    sscanf(line,"opens %lu",&sample->opens);
+    sscanf(line,"stats %lu",&sample->stats);
+  }
+  fclose(in);
+  
+  waitpid(child,&status,0);
+  clock_gettime(CLOCK_MONOTONIC,&end);
+  
+  sample->msec = (end.tv_sec  - start.tv_sec)  * 1000.0
+               + (end.tv_nsec - start.tv_nsec) / 1000000.0;
+               
+  return WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+/*************************************************************************/
+
+static int sample_cmp(void const *l,void const *r)
+{
+  struct sample const *left  = l;
+  struct sample const *right = r;
+  
+  if (left->msec < right->msec)
+    return -1;
+  else if (left->msec > right->msec)
+    return 1;
+  else
+    return 0;
+}
+
+/*************************************************************************/
+
+static void bench(
+        struct options const *opt,
+        char const           *name,
+        char const           *option,
+        char const           *(*arg)(int,int),
+        int                   first,
+        int                   last
+)
+{
+  struct sample *samples;
+  double         opens = 0.0;
+  double         stats = 0.0;
+  size_t         failed = 0;
+  
+  assert(opt    != NULL);
+  assert(name   != NULL);
+  assert(option != NULL);
+  
+  samples = calloc(opt->runs,sizeof(struct sample));
+  if (samples == NULL)
+    return;
+    
+  for (size_t i = 0 ; i < opt->runs ; i++)
+  {
+    char *argv[] =
+    {
+      (char *)opt->program,
+      (char *)"--config",
+      (char *)"blog.conf",
+      (char *)"--stats",
+      (char *)option,
+      arg != NULL ? (char *)(*arg)(first,last) : NULL,
+      NULL
+    };
+    
+    if (!run(opt,argv,&samples[i]))
+      failed++;
+    opens += samples[i].opens;
+    stats += samples[i].stats;
+  }
+  
+  qsort(samples,opt->runs,sizeof(struct sample),sample_cmp);
+  
+  printf(
+          "%-12s %8.2f %8.2f %8.2f %8.2f %8.1f %8.1f %6zu\n",
+          name,
+          samples[opt->runs * 50 / 100].msec,
+          samples[opt->runs * 90 / 100].msec,
+          samples[opt->runs * 99 / 100].msec,
+          samples[opt->runs - 1].msec,
+          opens / opt->runs,
+          stats / opt->runs,
+          failed
+        );
+        
+  free(samples);
+}
+
+/*************************************************************************/
+
+static char const *arg_entry(int first,int last)
+{
+  static char buf[32];
+  int         year = first + rand() % (last - first + 1);
+  
+  snprintf(buf,sizeof(buf),"%04d/%02d/%02d.1",year == last ? first : year,rand() % 12 + 1,rand() % 28 + 1);
+  return buf;
+}
+
+/*************************************************************************/
+
+static char const *arg_month(int first,int last)
+{
+  static char buf[32];
+  
+  snprintf(buf,sizeof(buf),"%04d/%02d",first + rand() % (last - first + 1),1);
+  return buf;
+}
+
+/*************************************************************************/
+
+static char const *arg_range(int first,int last)
+{
+  static char buf[32];
+  
+  snprintf(buf,sizeof(buf),"%04d-%04d",first,last);
+  return buf;
+}
+
+/*************************************************************************/
+
+static char const *arg_thisday(int first,int last)
+{
+  static char buf[32];
+  
+  (void)first;
+  (void)last;
+  snprintf(buf,sizeof(buf),"%02d/%02d",rand() % 12 + 1,rand() % 28 + 1);
+  return buf;
+}
+
+/*************************************************************************/
+
+int main(int argc,char *argv[])
+{
+  static struct option const coptions[] =
+  {
+    { "program"     , required_argument , NULL , 'p' } ,
+    { "templates"   , required_argument , NULL , 't' } ,
+    { "dir"         , required_argument , NULL , 'd' } ,
+    { "years"       , required_argument , NULL , 'y' } ,
+    { "posts"       , required_argument , NULL , 'n' } ,
+    { "body"        , required_argument , NULL , 'b' } ,
+    { "comments"    , required_argument , NULL , 'c' } ,
+    { "webmentions" , required_argument , NULL , 'w' } ,
+    { "runs"        , required_argument , NULL , 'r' } ,
+    { "seed"        , required_argument , NULL , 's' } ,
+    { "help"        , no_argument       , NULL , 'h' } ,
+    { NULL          , 0                 , NULL , 0   }
+  };
+  
+  struct options opt =
+  {
+    .program     = "src/main",
+    .templates   = "journal",
+    .dir         = NULL,
+    .years       = 5,
+    .posts       = 2,
+    .body        = 4096,
+    .comments    = 20,
+    .webmentions = 10,
+    .runs        = 50,
+    .seed        = 1,
+  };
+  
+  char program  [PATH_MAX];
+  char templates[PATH_MAX];
+  char dir      [PATH_MAX];
+  bool temporary;
+  int  first;
+  int  last;
+  
+  while(true)
+  {
+    int option = 0;
+    int c      = getopt_long_only(argc,argv,"",coptions,&option);
+    
+    if (c == EOF)
+      break;
+    else switch(c)
+    {
+      case 'p': opt.program     = optarg;                     break;
+      case 't': opt.templates   = optarg;                     break;
+      case 'd': opt.dir         = optarg;                     break;
+      case 'y': opt.years       = strtol(optarg,NULL,10);     break;
+      case 'n': opt.posts       = strtol(optarg,NULL,10);     break;
+      case 'b': opt.body        = strtoul(optarg,NULL,10);    break;
+      case 'c': opt.comments    = strtol(optarg,NULL,10);     break;
+      case 'w': opt.webmentions = strtol(optarg,NULL,10);     break;
+      case 'r': opt.runs        = strtoul(optarg,NULL,10);    break;
+      case 's': opt.seed        = strtoul(optarg,NULL,10);    break;
+      case 'h':
+      default:
+           fprintf(
+                stderr,
+                "usage: %s --options...\n"
+                "\t--program <blog program> (src/main)\n"
+                "\t--templates <dir with html/rss/atom/json templates> (journal)\n"
+                "\t--dir <dir for synthetic journal> (temporary)\n"
+                "\t--years <n> (5)\n"
+                "\t--posts <per day> (2)\n"
+                "\t--body <bytes per post> (4096)\n"
+                "\t--comments <percent of posts> (20)\n"
+                "\t--webmentions <percent of posts> (10)\n"
+                "\t--runs <per test> (50)\n"
+                "\t--seed <n> (1)\n"
+                "\t--help\n",
+                argv[0]
+              );
+           return EXIT_FAILURE;
+    }
+  }
+  
+  if ((opt.years < 1) || (opt.posts < 1) || (opt.posts > 23) || (opt.runs < 1))
+  {
+    fprintf(stderr,"%s: bad --years, --posts or --runs\n",argv[0]);
+    return EXIT_FAILURE;
+  }
+  
+  if ((realpath(opt.program,program) == NULL) || (realpath(opt.templates,templates) == NULL))
+  {
+    fprintf(stderr,"%s: %s\n",argv[0],strerror(errno));
+    return EXIT_FAILURE;
+  }
+  
+  opt.program   = program;
+  opt.templates = templates;
+  temporary     = opt.dir == NULL;
+  
+  if (temporary)
+  {
+    snprintf(dir,sizeof(dir),"/tmp/mod_blog-bench.XXXXXX");
+    if (mkdtemp(dir) == NULL)
+    {
+      fprintf(stderr,"%s: %s\n",dir,strerror(errno));
+      return EXIT_FAILURE;
+    }
+  }
+  else
+  {
+    mkdir(opt.dir,0777);
+    if (realpath(opt.dir,dir) == NULL)
+    {
+      fprintf(stderr,"%s: %s\n",opt.dir,strerror(errno));
+      return EXIT_FAILURE;
+    }
+  }
+  
+  opt.dir = dir;
+  
+  if (chdir(opt.dir) < 0)
+  {
+    fprintf(stderr,"%s: %s\n",opt.dir,strerror(errno));
+    if (temporary)
+      remove_tree(dir);
+    return EXIT_FAILURE;
+  }
+  
+  srand(opt.seed);
+  fprintf(stderr,"generating journal in %s ...\n",opt.dir);
+  if (!make_journal(&opt,&first,&last))
+  {
+    if (temporary)
+      remove_tree(dir);
+    return EXIT_FAILURE;
+  }
+  
+  printf("%-12s %8s %8s %8s %8s %8s %8s %6s\n","test","p50 ms","p90 ms","p99 ms","max ms","opens","stats","failed");
+  bench(&opt,"regenerate","--regenerate",NULL,       first,last);
+  bench(&opt,"entry",     "--entry",     arg_entry,  first,last);
+  bench(&opt,"month",     "--entry",     arg_month,  first,last);
+  bench(&opt,"range",     "--entry",     arg_range,  first,last);
+  bench(&opt,"today",     "--today",     NULL,       first,last);
+  bench(&opt,"thisday",   "--thisday",   arg_thisday,first,last);
+  
+  /*----------------------------------------------------------------------
+  ; A journal given with --dir is left for a look afterwards; one of our
+  ; own isn't.
+  ;-----------------------------------------------------------------------*/
+  
+  if (temporary)
+    remove_tree(dir);
+  return EXIT_SUCCESS;
+}
+
+/*************************************************************************/
@@ -0,0 +1,413 @@
+/************************************************************************
+*
+* Copyright 2026 by Sean Conner.  All Rights Reserved.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*
+* Comments, questions and criticisms can be sent to: sean@conman.org
+*
+*************************************************************************/
+
+/*************************************************************************
+*
+* Benchmark the template engine by itself.  A fixed set of entries is built
+* in memory (so nothing is read from the journal) and rendered through each
+* of the sample templates, reporting the time and the number of allocations
+* (and bytes allocated) per entry.  This covers generic_cb() and the chunk
+* dispatch, the HTML rewriting of cb_entry_body() and the entity and JSON
+* encoders, but not the storage layer.
+*
+* The blog itself is set up with a small configuration in a scratch
+* directory, which has no entries, so the lookups for comments, webmentions
+* and ads all come up empty.
+*
+* Allocations are counted by wrapping malloc() and friends, which relies
+* upon the GNU C library exporting __libc_malloc() and company.  In a build
+* with ALLOC_STATS, the wrappers in stats.c are used instead.
+*
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <assert.h>
+
+#include <getopt.h>
+#include <unistd.h>
+#include <limits.h>
+#include <ftw.h>
+
+#include "../src/backend.h"
+#include "../src/frontend.h"
+#include "../src/blog.h"
+#include "../src/stats.h"
+
+static char const m_body[] =
+  "<p>This is a <em>sample</em> entry, with a <a href=\"/2020/01/01.1\">link\n"
+  "to a previous entry</a>, a <a href=\"asin:0201633612\">shorthand link</a>\n"
+  "and a <a href=\"https://www.example.com/?a=1&amp;b=2\">full link</a>.  There\n"
+  "are &ldquo;entities&rdquo; &mdash; and some \"quotes\" &amp; things &lt;here&gt;.</p>\n"
+  "\n"
+  "<blockquote>\n"
+  "  <p>Some quoted text, <q>nested quotes</q> and <code>code();</code></p>\n"
+  "</blockquote>\n"
+  "\n"
+  "<pre class=\"language-c\">\n"
+  "int main(void)\n"
+  "{\n"
+  "  return printf(\"Hello, world!\\n\") &lt; 0;\n"
+  "}\n"
+  "</pre>\n"
+  "\n"
+  "<p><img src=\"/2020/01/01/photo.jpg\" alt=\"[A photo]\" title=\"A photo\"></p>\n"
+  "\n"
+  "<ul>\n"
+  "  <li>one</li>\n"
+  "  <li>two &amp; three</li>\n"
+  "  <li>four</li>\n"
+  "</ul>\n";
+
+/*************************************************************************/
+
+#ifdef ALLOC_STATS
+
+static void allocated(unsigned long *count,unsigned long *bytes)
+{
+  stats_allocated(count,bytes);
+}
+
+#else
+
+extern void *__libc_malloc  (size_t);
+extern void *__libc_calloc  (size_t,size_t);
+extern void *__libc_realloc (void *,size_t);
+extern void  __libc_free    (void *);
+
+static unsigned long m_allocs;
+static unsigned long m_bytes;
+
+/*************************************************************************/
+
+void *malloc(size_t size)
+{
+  m_allocs++;
+  m_bytes += size;
+  return __libc_malloc(size);
+}
+
+/*************************************************************************/
+
+void *calloc(size_t nmemb,size_t size)
+{
+  m_allocs++;
+  m_bytes += nmemb * size;
+  return __libc_calloc(nmemb,size);
+}
+
+/*************************************************************************/
+
+void *realloc(void *ptr,size_t size)
+{
+  m_allocs++;
+  m_bytes += size;
+  return __libc_realloc(ptr,size);
+}
+
+/*************************************************************************/
+
+void free(void *ptr)
+{
+  __libc_free(ptr);
+}
+
+/*************************************************************************/
+
+static void allocated(unsigned long *count,unsigned long *bytes)
+{
+  *count = m_allocs;
+  *bytes = m_bytes;
+}
+
+#endif
+
+/*************************************************************************/
+
+static double now_ns(void)
+{
+  struct timespec now;
+  
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return now.tv_sec * 1000000000.0 + now.tv_nsec;
+}
+
+/*************************************************************************/
+
+static int remove_entry(char const *path,struct stat const *status,int flag,struct FTW *ftw)
+{
+  (void)status;
+  (void)flag;
+  (void)ftw;
+  
+  if (remove(path) != 0)
+    perror(path);
+  return 0;
+}
+
+/*************************************************************************/
+
+static void remove_tree(char const *dir)
+{
+  assert(dir != NULL);
+  
+  if (nftw(dir,remove_entry,16,FTW_DEPTH | FTW_PHYS) != 0)
+    perror(dir);
+}
+
+/*************************************************************************/
+
+static Blog *blog_setup(char *dir,size_t size,char const *templates)
+{
+  char  path[PATH_MAX + sizeof("/blog.conf")];
+  FILE *fp;
+  
+  assert(dir       != NULL);
+  assert(templates != NULL);
+  
+  snprintf(dir,size,"/tmp/mod_blog-render.XXXXXX");
+  if (mkdtemp(dir) == NULL)
+  {
+    perror(dir);
+    *dir = '\0';
+    return NULL;
+  }
+  
+  snprintf(path,sizeof(path),"%s/.first",dir);
+  fp = fopen(path,"w");
+  if (fp == NULL)
+  {
+    perror(path);
+    return NULL;
+  }
+  fputs("2020/01/01.1\n",fp);
+  fclose(fp);
+  
+  snprintf(path,sizeof(path),"%s/.last",dir);
+  fp = fopen(path,"w");
+  if (fp == NULL)
+  {
+    perror(path);
+    return NULL;
+  }
+  fputs("2020/01/08.2\n",fp);
+  fclose(fp);
+  
+  snprintf(path,sizeof(path),"%s/blog.conf",dir);
+  fp = fopen(path,"w");
+  if (fp == NULL)
+  {
+    perror(path);
+    return NULL;
+  }
+  fprintf(
+        fp,
+        "name     = \"Benchmark\"\n"
+        "basedir  = \"%s\"\n"
+        "webdir   = \"%s\"\n"
+        "url      = \"http://www.example.com/blog/\"\n"
+        "adtag    = \"programming\"\n"
+        "author   = { name = \"Joe Blog\" , email = \"joe@example.com\" }\n"
+        "affiliate = { { proto = \"asin\" , link = \"http://www.amazon.com/exec/obidos/ASIN/%%s/\" } }\n"
+        "templates =\n"
+        "{\n"
+        "  { template = \"%s/html\" , output = \"/dev/null\" , items = 15 , reverse = true },\n"
+        "  { template = \"%s/rss\"  , output = \"/dev/null\" , items = 15 , reverse = true },\n"
+        "  { template = \"%s/atom\" , output = \"/dev/null\" , items = 15 , reverse = true },\n"
+        "  { template = \"%s/json\" , output = \"/dev/null\" , items = 15 , reverse = true },\n"
+        "}\n",
+        dir,
+        dir,
+        templates,
+        templates,
+        templates,
+        templates
+  );
+  fclose(fp);
+  
+  return BlogNew(path);
+}
+
+/*************************************************************************/
+
+static void entries_make(Blog *blog,List *list,size_t count)
+{
+  assert(blog != NULL);
+  assert(list != NULL);
+  
+  for (size_t i = 0 ; i < count ; i++)
+  {
+    BlogEntry *entry = BlogEntryNew(blog);
+    
+    entry->when.year  = 2020;
+    entry->when.month = 1;
+    entry->when.day   = 8 - i / 2 % 8;
+    entry->when.part  = 2 - i % 2;
+    entry->timestamp  = 1577836800 + i * 3600;
+    entry->title      = strdup("A \"sample\" entry & <title>");
+    entry->class      = strdup("programming, C, Lua, random stuff");
+    entry->author     = strdup("Joe Blog");
+    entry->status     = strdup("");
+    entry->adtag      = strdup("");
+    entry->body       = strdup(m_body);
+    ListAddTail(list,&entry->node);
+  }
+}
+
+/*************************************************************************/
+
+int main(int argc,char *argv[])
+{
+  static struct option const coptions[] =
+  {
+    { "templates"  , required_argument , NULL , 't' } ,
+    { "entries"    , required_argument , NULL , 'e' } ,
+    { "iterations" , required_argument , NULL , 'i' } ,
+    { "help"       , no_argument       , NULL , 'h' } ,
+    { NULL         , 0                 , NULL , 0   }
+  };
+  
+  char const *templates  = "journal";
+  size_t      entries    = 15;
+  size_t      iterations = 200;
+  char        dir[PATH_MAX];
+  char        tmpdir[PATH_MAX];
+  Blog       *blog;
+  FILE       *out;
+  
+  while(true)
+  {
+    int option = 0;
+    int c      = getopt_long_only(argc,argv,"",coptions,&option);
+    
+    if (c == EOF)
+      break;
+    else switch(c)
+    {
+      case 't': templates  = optarg;                  break;
+      case 'e': entries    = strtoul(optarg,NULL,10); break;
+      case 'i': iterations = strtoul(optarg,NULL,10); break;
+      case 'h':
+      default:
+           fprintf(
+                stderr,
+                "usage: %s [options]\n"
+                "\t--templates <dir with html/rss/atom/json templates> (journal)\n"
+                "\t--entries <n> (15)\n"
+                "\t--iterations <n> (200)\n"
+                "\t--help\n",
+                argv[0]
+              );
+           return EXIT_FAILURE;
+    }
+  }
+  
+  if ((entries == 0) || (iterations == 0))
+  {
+    fprintf(stderr,"%s: bad --entries or --iterations\n",argv[0]);
+    return EXIT_FAILURE;
+  }
+  
+  if (realpath(templates,dir) == NULL)
+  {
+    perror(templates);
+    return EXIT_FAILURE;
+  }
+  
+  blog = blog_setup(tmpdir,sizeof(tmpdir),dir);
+  if (blog == NULL)
+  {
+    fprintf(stderr,"%s: cannot set up blog\n",argv[0]);
+    if (*tmpdir != '\0')
+      remove_tree(tmpdir);
+    return EXIT_FAILURE;
+  }
+  
+  out = fopen("/dev/null","w");
+  if (out == NULL)
+  {
+    perror("/dev/null");
+    BlogFree(blog);
+    remove_tree(tmpdir);
+    return EXIT_FAILURE;
+  }
+  
+  printf("%-10s %12s %14s %14s\n","template","ns/entry","allocs/entry","bytes/entry");
+  
+  for (size_t t = 0 ; t < blog->config.templatenum ; t++)
+  {
+    double        elapsed = 0.0;
+    unsigned long allocs  = 0;
+    unsigned long bytes   = 0;
+    char const   *name    = strrchr(blog->config.templates[t].template,'/') + 1;
+    
+    for (size_t i = 0 ; i < iterations ; i++)
+    {
+      struct callback_data cbd;
+      Request              request;
+      double               start;
+      unsigned long        before;
+      unsigned long        after;
+      unsigned long        bbefore;
+      unsigned long        bafter;
+      
+      request_init(&request);
+      request.f.fullurl = blog->config.templates[t].fullurl;
+      request.f.reverse = blog->config.templates[t].reverse;
+      callback_init(&cbd,blog,&request);
+      cbd.template = &blog->config.templates[t];
+      entries_make(blog,&cbd.list,entries);
+      
+      /*-------------------------------------------------------------------
+      ; The entries are freed as they're rendered, which is counted, but
+      ; not their creation.
+      ;--------------------------------------------------------------------*/
+      
+      allocated(&before,&bbefore);
+      start    = now_ns();
+      generic_main(out,&cbd);
+      elapsed += now_ns() - start;
+      allocated(&after,&bafter);
+      allocs  += after  - before;
+      bytes   += bafter - bbefore;
+    }
+    
+    printf(
+        "%-10s %12.0f %14.1f %14.1f\n",
+        name,
+        elapsed / (iterations * entries),
+        (double)allocs / (iterations * entries),
+        (double)bytes  / (iterations * entries)
+    );
+  }
+  
+  fclose(out);
+  BlogFree(blog);
+  remove_tree(tmpdir);
+  return EXIT_SUCCESS;
+}
+
+/*************************************************************************/
@@ -0,0 +1,572 @@
+/************************************************************************
+*
+* Copyright 2026 by Sean Conner.  All Rights Reserved.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*
+* Comments, questions and criticisms can be sent to: sean@conman.org
+*
+*************************************************************************/
+
+/*************************************************************************
+*
+* Microbenchmarks for the tumbler parser, which is run on every GET.  There
+* are three modes:
+*
+*       tumbler [--iterations n]
+*               time tumbler_new() and tumbler_canonical() for each type
+*               of tumbler, and for a mix weighted like actual traffic.
+*
+*       tumbler --check <corpus>
+*               parse each tumbler in the corpus and compare the results
+*               with what was recorded.  Any difference is reported.
+*
+*       tumbler --record <corpus>
+*               parse each tumbler in the corpus and print the corpus back
+*               out with the current results.
+*
+*       tumbler --fuzz <n> <corpus>
+*               mutate tumblers from the corpus <n> times, and make sure
+*               any accepted tumbler canonicalizes to a tumbler that parses
+*               back to the same thing.  Failures are printed in corpus
+*               format.
+*
+* The corpus has one tumbler per line, as
+*
+*       <tumbler> TAB error
+*       <tumbler> TAB okay TAB <canonical form>
+*       <tumbler> TAB redirect TAB <canonical form>
+*
+* Blank lines and lines starting with '#' are ignored.  All parsing is
+* done against a fixed first and last entry, so the results don't change
+* with the date.
+*
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include <getopt.h>
+
+#include "../src/wbtum.h"
+
+#define POOL    1024
+
+struct category
+{
+  char const  *name;
+  int          weight;  /* percent of requests */
+  void       (*make)(char *,size_t);
+};
+
+static struct btm const m_first = { .year = 1999 , .month = 12 , .day =  4 , .part = 1 };
+static struct btm const m_last  = { .year = 2026 , .month = 10 , .day = 18 , .part = 3 };
+
+static volatile size_t  m_sink;
+
+/*************************************************************************/
+
+static void random_date(int *year,int *month,int *day)
+{
+  *year  = 2000 + rand() % 26;
+  *month = rand() % 12 + 1;
+  *day   = rand() % max_monthday(*year,*month) + 1;
+}
+
+/*************************************************************************/
+
+static void make_entry(char *buf,size_t size)
+{
+  int year,month,day;
+  
+  random_date(&year,&month,&day);
+  snprintf(buf,size,"%d/%02d/%02d.%d",year,month,day,rand() % 3 + 1);
+}
+
+/*************************************************************************/
+
+static void make_day(char *buf,size_t size)
+{
+  int year,month,day;
+  
+  random_date(&year,&month,&day);
+  snprintf(buf,size,"%d/%02d/%02d",year,month,day);
+}
+
+/*************************************************************************/
+
+static void make_month(char *buf,size_t size)
+{
+  int year,month,day;
+  
+  random_date(&year,&month,&day);
+  if (rand() % 5 == 0)
+    snprintf(buf,size,"%d",year);
+  else
+    snprintf(buf,size,"%d/%02d",year,month);
+}
+
+/*************************************************************************/
+
+static void make_redirect(char *buf,size_t size)
+{
+  int year,month,day;
+  
+  random_date(&year,&month,&day);
+  switch(rand() % 3)
+  {
+    case 0:  snprintf(buf,size,"%d/%d/%d.%d",year,month,day,rand() % 3 + 1); break;
+    case 1:  snprintf(buf,size,"%d/%02d/%02d/",year,month,day); break;
+    default: snprintf(buf,size,"%d/%02d/%02d.0%d",year,month,day,rand() % 3 + 1); break;
+  }
+}
+
+/*************************************************************************/
+
+static void make_range(char *buf,size_t size)
+{
+  int year,month,day;
+  
+  random_date(&year,&month,&day);
+  switch(rand() % 4)
+  {
+    case 0:  snprintf(buf,size,"%d/%02d/%02d.1-3",year,month,day); break;
+    case 1:  snprintf(buf,size,"%d/%02d-%02d",year,month,month); break;
+    case 2:  snprintf(buf,size,"%d/%02d/01-%02d/%02d",year,month,month,day); break;
+    default: snprintf(buf,size,"%d-%d",year,year + rand() % (2027 - year)); break;
+  }
+}
+
+/*************************************************************************/
+
+static void make_file(char *buf,size_t size)
+{
+  int year,month,day;
+  
+  random_date(&year,&month,&day);
+  snprintf(buf,size,"%d/%02d/%02d/photo%d.jpg",year,month,day,rand() % 10);
+}
+
+/*************************************************************************/
+
+static void make_invalid(char *buf,size_t size)
+{
+  int year,month,day;
+  
+  random_date(&year,&month,&day);
+  switch(rand() % 4)
+  {
+    case 0:  snprintf(buf,size,"%d/%02d/%02d.1",year + 30,month,day); break;
+    case 1:  snprintf(buf,size,"%d/%02d/32",year,month); break;
+    case 2:  snprintf(buf,size,"wp-login.php"); break;
+    default: snprintf(buf,size,"%d/%02d/%02d.99",year,month,day); break;
+  }
+}
+
+/*************************************************************************/
+
+static struct category const m_categories[] =
+{
+  { "entry"    , 55 , make_entry    } ,
+  { "day"      , 15 , make_day      } ,
+  { "month"    ,  8 , make_month    } ,
+  { "redirect" ,  8 , make_redirect } ,
+  { "range"    ,  5 , make_range    } ,
+  { "file"     ,  5 , make_file     } ,
+  { "invalid"  ,  4 , make_invalid  } ,
+};
+
+#define CATEGORIES (sizeof(m_categories) / sizeof(m_categories[0]))
+
+/*************************************************************************/
+
+static double now_ns(void)
+{
+  struct timespec now;
+  
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return now.tv_sec * 1000000000.0 + now.tv_nsec;
+}
+
+/*************************************************************************/
+
+static void time_pool(char const *name,char (*pool)[64],size_t iterations)
+{
+  tumbler__s tum;
+  double     start;
+  double     parse;
+  double     canon;
+  size_t     accepted = 0;
+  
+  assert(name != NULL);
+  assert(pool != NULL);
+  
+  start = now_ns();
+  for (size_t i = 0 ; i < iterations ; i++)
+    for (size_t j = 0 ; j < POOL ; j++)
+      m_sink += tumbler_new(&tum,pool[j],&m_first,&m_last);
+  parse = (now_ns() - start) / (iterations * POOL);
+  
+  /*-----------------------------------------------------------------------
+  ; Only accepted tumblers are ever canonicalized, so only time those.
+  ;------------------------------------------------------------------------*/
+  
+  start = now_ns();
+  for (size_t i = 0 ; i < iterations ; i++)
+    for (size_t j = 0 ; j < POOL ; j++)
+    {
+      if (tumbler_new(&tum,pool[j],&m_first,&m_last))
+      {
+        char *canonical = tumbler_canonical(&tum);
+        m_sink += strlen(canonical);
+        free(canonical);
+        accepted++;
+      }
+    }
+  canon = accepted > 0 ? (now_ns() - start) / accepted - parse : 0.0;
+  
+  printf("%-10s %12.1f %12.1f %9.1f%%\n",name,parse,canon,100.0 * accepted / (iterations * POOL));
+}
+
+/*************************************************************************/
+
+static void bench(size_t iterations)
+{
+  static char pool[POOL][64];
+  
+  printf("%-10s %12s %12s %10s\n","tumbler","parse ns/op","canon ns/op","accepted");
+  
+  for (size_t c = 0 ; c < CATEGORIES ; c++)
+  {
+    for (size_t i = 0 ; i < POOL ; i++)
+      m_categories[c].make(pool[i],sizeof(pool[i]));
+    time_pool(m_categories[c].name,pool,iterations);
+  }
+  
+  for (size_t i = 0 ; i < POOL ; i++)
+  {
+    int    pick = rand() % 100;
+    size_t c    = 0;
+    
+    while((c < CATEGORIES - 1) && (pick >= m_categories[c].weight))
+      pick -= m_categories[c++].weight;
+    m_categories[c].make(pool[i],sizeof(pool[i]));
+  }
+  time_pool("mix",pool,iterations);
+}
+
+/*************************************************************************/
+
+static char *result(char const *text)
+{
+  tumbler__s  tum;
+  char       *canonical;
+  char       *ret;
+  
+  assert(text != NULL);
+  
+  if (!tumbler_new(&tum,text,&m_first,&m_last))
+    return strdup("error");
+    
+  canonical = tumbler_canonical(&tum);
+  if (asprintf(&ret,"%s\t%s",tum.redirect ? "redirect" : "okay",canonical) == -1)
+    ret = NULL;
+  free(canonical);
+  return ret;
+}
+
+/*************************************************************************/
+
+static int corpus(char const *fname,bool record)
+{
+  FILE   *fp;
+  char   *line = NULL;
+  size_t  size = 0;
+  ssize_t len;
+  size_t  lineno = 0;
+  size_t  count  = 0;
+  size_t  failed = 0;
+  
+  assert(fname != NULL);
+  
+  fp = fopen(fname,"r");
+  if (fp == NULL)
+  {
+    perror(fname);
+    return EXIT_FAILURE;
+  }
+  
+  while((len = getline(&line,&size,fp)) != -1)
+  {
+    char *expected;
+    char *got;
+    
+    lineno++;
+    if ((len > 0) && (line[len - 1] == '\n'))
+      line[--len] = '\0';
+      
+    if ((*line == '\0') || (*line == '#'))
+    {
+      if (record)
+        puts(line);
+      continue;
+    }
+    
+    expected = strchr(line,'\t');
+    if (expected != NULL)
+      *expected++ = '\0';
+    else
+      expected = (char *)"";
+      
+    got = result(line);
+    count++;
+    
+    if (record)
+      printf("%s\t%s\n",line,got);
+    else if (strcmp(expected,got) != 0)
+    {
+      printf("%s:%zu: %s\n\texpected: %s\n\tgot:      %s\n",fname,lineno,line,expected,got);
+      failed++;
+    }
+    
+    free(got);
+  }
+  
+  free(line);
+  fclose(fp);
+  
+  if (!record)
+    fprintf(stderr,"%zu tumblers, %zu failed\n",count,failed);
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*************************************************************************/
+
+static bool same(tumbler__s const *a,tumbler__s const *b)
+{
+  assert(a != NULL);
+  assert(b != NULL);
+  
+  return (btm_cmp(&a->start,&b->start) == 0)
+      && (btm_cmp(&a->stop, &b->stop)  == 0)
+      && (a->ustart == b->ustart)
+      && (a->ustop  == b->ustop)
+      && (a->range  == b->range)
+      && (a->file   == b->file)
+      && (strcmp(a->filename,b->filename) == 0)
+      ;
+}
+
+/*************************************************************************/
+
+static void mutate(char *buf,size_t size,char (*seeds)[64],size_t nseeds)
+{
+  static char const alphabet[] = "0123456789/.-x";
+  size_t            len;
+  
+  assert(buf    != NULL);
+  assert(seeds  != NULL);
+  assert(nseeds >  0);
+  
+  snprintf(buf,size,"%s",seeds[rand() % nseeds]);
+  
+  for (int n = rand() % 4 + 1 ; n > 0 ; n--)
+  {
+    len = strlen(buf);
+    
+    switch(rand() % 4)
+    {
+      case 0: /* change a character */
+           if (len > 0)
+             buf[rand() % len] = alphabet[rand() % (sizeof(alphabet) - 1)];
+           break;
+           
+      case 1: /* insert a character */
+           if (len + 1 < size)
+           {
+             size_t at = rand() % (len + 1);
+             memmove(&buf[at + 1],&buf[at],len - at + 1);
+             buf[at] = alphabet[rand() % (sizeof(alphabet) - 1)];
+           }
+           break;
+           
+      case 2: /* delete a character */
+           if (len > 0)
+           {
+             size_t at = rand() % len;
+             memmove(&buf[at],&buf[at + 1],len - at);
+           }
+           break;
+           
+      case 3: /* splice in the tail of another seed */
+           {
+             char const *other = seeds[rand() % nseeds];
+             size_t      at    = len > 0 ? rand() % len : 0;
+             size_t      from  = rand() % (strlen(other) + 1);
+             snprintf(&buf[at],size - at,"%s",&other[from]);
+           }
+           break;
+    }
+  }
+}
+
+/*************************************************************************/
+
+static int fuzz(size_t runs,char const *fname)
+{
+  static char  seeds[4096][64];
+  size_t       nseeds = 0;
+  size_t       failed = 0;
+  size_t       accepted = 0;
+  FILE        *fp;
+  char         line[BUFSIZ];
+  
+  assert(fname != NULL);
+  
+  fp = fopen(fname,"r");
+  if (fp == NULL)
+  {
+    perror(fname);
+    return EXIT_FAILURE;
+  }
+  
+  while((nseeds < sizeof(seeds) / sizeof(seeds[0])) && (fgets(line,sizeof(line),fp) != NULL))
+  {
+    if ((*line == '#') || (*line == '\n'))
+      continue;
+    line[strcspn(line,"\t\n")] = '\0';
+    if (strlen(line) < sizeof(seeds[0]))
+      strcpy(seeds[nseeds++],line);
+  }
+  fclose(fp);
+  
+  if (nseeds == 0)
+  {
+    fprintf(stderr,"%s: no tumblers\n",fname);
+    return EXIT_FAILURE;
+  }
+  
+  for (size_t i = 0 ; i < runs ; i++)
+  {
+    char        text[64];
+    tumbler__s  tum;
+    tumbler__s  again;
+    char       *canonical;
+    char       *got;
+    
+    mutate(text,sizeof(text),seeds,nseeds);
+    if (!tumbler_new(&tum,text,&m_first,&m_last))
+      continue;
+      
+    accepted++;
+    
+    /*---------------------------------------------------------------------
+    ; The canonical form is what we redirect to, so it had better parse,
+    ; not redirect again, and mean the same thing.
+    ;----------------------------------------------------------------------*/
+    
+    canonical = tumbler_canonical(&tum);
+    if (
+            (canonical == NULL)
+         || !tumbler_new(&again,canonical,&m_first,&m_last)
+         || again.redirect
+         || !same(&tum,&again)
+       )
+    {
+      got = result(text);
+      printf("%s\t%s\n",text,got);
+      free(got);
+      failed++;
+    }
+    
+    free(canonical);
+  }
+  
+  fprintf(stderr,"%zu runs, %zu accepted, %zu failed\n",runs,accepted,failed);
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*************************************************************************/
+
+int main(int argc,char *argv[])
+{
+  static struct option const coptions[] =
+  {
+    { "iterations" , required_argument , NULL , 'i' } ,
+    { "check"      , required_argument , NULL , 'c' } ,
+    { "record"     , required_argument , NULL , 'r' } ,
+    { "fuzz"       , required_argument , NULL , 'f' } ,
+    { "seed"       , required_argument , NULL , 's' } ,
+    { "help"       , no_argument       , NULL , 'h' } ,
+    { NULL         , 0                 , NULL , 0   }
+  };
+  
+  size_t iterations = 1000;
+  size_t runs       = 0;
+  
+  srand(1);
+  
+  while(true)
+  {
+    int option = 0;
+    int c      = getopt_long_only(argc,argv,"",coptions,&option);
+    
+    if (c == EOF)
+      break;
+    else switch(c)
+    {
+      case 'i': iterations = strtoul(optarg,NULL,10); break;
+      case 'c': return corpus(optarg,false);
+      case 'r': return corpus(optarg,true);
+      case 'f': runs = strtoul(optarg,NULL,10); break;
+      case 's': srand(strtoul(optarg,NULL,10)); break;
+      case 'h':
+      default:
+           fprintf(
+                stderr,
+                "usage: %s [options]\n"
+                "\t--iterations <n> (1000)\n"
+                "\t--check <corpus>\n"
+                "\t--record <corpus>\n"
+                "\t--fuzz <n> <corpus>\n"
+                "\t--seed <n> (1)\n"
+                "\t--help\n",
+                argv[0]
+              );
+           return EXIT_FAILURE;
+    }
+  }
+  
+  if (runs > 0)
+  {
+    if (optind >= argc)
+    {
+      fprintf(stderr,"%s: --fuzz needs a corpus\n",argv[0]);
+      return EXIT_FAILURE;
+    }
+    return fuzz(runs,argv[optind]);
+  }
+  
+  if (iterations == 0)
+    iterations = 1;
+  bench(iterations);
+  return EXIT_SUCCESS;
+}
+
+/*************************************************************************/
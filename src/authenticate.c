@@ -25,6 +25,7 @@
 #include <stdlib.h>
 
 #include <syslog.h>
+#include <sys/stat.h>
 #include <cgilib8/util.h>
 
 #include "frontend.h"
@@ -56,42 +57,65 @@ char *get_remote_user(void)
   return strdup(name);
 }
 
+/************************************************************************
+*
+* The author file is read in one go and kept, split in place, with a hash
+* of the user ids (the first line for a given id wins, as it did when the
+* file was scanned for each post).  It's checked against the file (by
+* inode, size and modification time) on each use, and read again if it has
+* changed, so a long running process sees edits to it, and a short one
+* reads it at most once.
+*
+*************************************************************************/
+
+struct authorent
+{
+  char const *uid;
+  char const *name;
+};
+
+static struct
+{
+  char             *file;
+  struct fields     fields;
+  dev_t             dev;
+  ino_t             ino;
+  off_t             size;
+  struct timespec   mtime;
+  char             *text;
+  struct authorent *hash;
+  size_t            hashsize; /* power of 2 */
+} m_authors;
+
+/************************************************************************/
+
+static void authors_free(void)
+{
+  free(m_authors.file);
+  free(m_authors.text);
+  free(m_authors.hash);
+  memset(&m_authors,0,sizeof(m_authors));
+}
+
 /************************************************************************/
 
-static size_t breakline(char *dest[],size_t dsize,FILE *in)
+static size_t breakline(char *dest[],size_t dsize,char *line)
 {
-  char    *line = NULL;
-  char    *p;
-  char    *colon;
-  size_t   cnt;
-  size_t   size = 0;
-  ssize_t  rc;
+  char   *colon;
+  size_t  cnt = 0;
   
   assert(dest  != NULL);
   assert(dsize >  0);
-  assert(in    != NULL);
-  
-  rc = getline(&line,&size,in);
-  if ((rc == -1) || (emptynull_string(line)))
-  {
-    free(line);
-    return 0;
-  }
-  
-  if (line[rc - 1] == '\n')
-    line[rc - 1] = '\0';
-    
-  p   = line;
-  cnt = 0;
+  assert(line  != NULL);
   
   do
   {
-    dest[cnt] = p;
-    colon = strchr(p,':');
+    dest[cnt] = line;
+    colon = strchr(line,':');
     if (colon != NULL)
     {
       *colon = '\0';
-      p      = colon + 1;
+      line   = colon + 1;
     }
     cnt++;
   } while ((colon != NULL) && (cnt < dsize));
@@ -101,50 +125,165 @@ static size_t breakline(char *dest[],size_t dsize,FILE *in)
 
 /************************************************************************/
 
-bool authenticate_author(Blog const *blog,Request *req)
+static struct authorent *authors_find(char const *uid)
 {
-  FILE   *in;
-  char   *lines[10];
-  size_t  cnt;
+  size_t mask = m_authors.hashsize - 1;
+  size_t h;
   
-  assert(blog        != NULL);
-  assert(req         != NULL);
-  assert(req->author != NULL);
+  assert(uid != NULL);
   
-  if (blog->config.author.file == NULL)
-    return strcmp(req->author,blog->config.author.name) == 0;
+  h = hash_mem(HASH_INIT,uid,strlen(uid)) & mask;
+  while((m_authors.hash[h].uid != NULL) && (strcmp(m_authors.hash[h].uid,uid) != 0))
+    h = (h + 1) & mask;
+  return &m_authors.hash[h];
+}
+
+/************************************************************************/
+
+static bool authors_load(char const *file,struct fields const *fields)
+{
+  struct stat  status;
+  FILE        *in;
+  char        *line;
+  char        *next;
+  char        *end;
+  size_t       lines;
+  size_t       len;
+  
+  assert(file   != NULL);
+  assert(fields != NULL);
+  
+  if (stat(file,&status) == -1)
+  {
+    syslog(LOG_ERR,"%s: %s",file,strerror(errno));
+    return false;
+  }
+  
+  if (
+          (m_authors.text          != NULL)
+       && (m_authors.dev           == status.st_dev)
+       && (m_authors.ino           == status.st_ino)
+       && (m_authors.size          == status.st_size)
+       && (m_authors.mtime.tv_sec  == status.st_mtim.tv_sec)
+       && (m_authors.mtime.tv_nsec == status.st_mtim.tv_nsec)
+       && (m_authors.fields.uid    == fields->uid)
+       && (m_authors.fields.name   == fields->name)
+       && (strcmp(m_authors.file,file) == 0)
+     )
+    return true;
     
-  in = fopen(blog->config.author.file,"r");
+  authors_free();
+  
+  in = fopen(file,"r");
   if (in == NULL)
   {
-    syslog(LOG_ERR,"%s: %s",blog->config.author.file,strerror(errno));
+    syslog(LOG_ERR,"%s: %s",file,strerror(errno));
+    return false;
+  }
+  
+  /*----------------------------------------------------------------------
+  ; What's kept is what was read, so take the stamp from the open file in
+  ; case it was replaced since the stat() above.
+  ;-----------------------------------------------------------------------*/
+  
+  if (fstat(fileno(in),&status) == -1)
+  {
+    syslog(LOG_ERR,"%s: %s",file,strerror(errno));
+    fclose(in);
+    return false;
+  }
+  
+  m_authors.text = malloc(status.st_size + 1);
+  m_authors.file = strdup(file);
+  if ((m_authors.text == NULL) || (m_authors.file == NULL))
+  {
+    syslog(LOG_ERR,"%s: %s",file,strerror(ENOMEM));
+    fclose(in);
+    authors_free();
+    return false;
+  }
+  
+  len = fread(m_authors.text,1,status.st_size,in);
+  fclose(in);
+  m_authors.text[len] = '\0';
+  end                 = &m_authors.text[len];
+  
+  lines = 1;
+  for (char const *p = m_authors.text ; (p = strchr(p,'\n')) != NULL ; p++)
+    lines++;
+    
+  for (m_authors.hashsize = 16 ; m_authors.hashsize < lines * 2 ; m_authors.hashsize *= 2)
+    ;
+    
+  m_authors.hash = calloc(m_authors.hashsize,sizeof(struct authorent));
+  if (m_authors.hash == NULL)
+  {
+    syslog(LOG_ERR,"%s: %s",file,strerror(ENOMEM));
+    authors_free();
     return false;
   }
   
-  while((cnt = breakline(lines,10,in)))
+  m_authors.fields = *fields;
+  m_authors.dev    = status.st_dev;
+  m_authors.ino    = status.st_ino;
+  m_authors.size   = status.st_size;
+  m_authors.mtime  = status.st_mtim;
+  
+  for (line = m_authors.text ; line < end ; line = next)
   {
-    if ((blog->config.author.fields.uid < cnt) && (strcmp(req->author,lines[blog->config.author.fields.uid]) == 0))
+    char   *field[10];
+    size_t  cnt;
+    
+    next = strchr(line,'\n');
+    if (next != NULL)
+      *next++ = '\0';
+    else
+      next = end;
+      
+    cnt = breakline(field,10,line);
+    if ((fields->uid < cnt) && (fields->name < cnt))
     {
-      if (blog->config.author.fields.name < cnt)
+      struct authorent *ent = authors_find(field[fields->uid]);
+      
+      if (ent->uid == NULL)
       {
-        free(req->author);
-        req->author = strdup(lines[blog->config.author.fields.name]);
-        fclose(in);
-        free(lines[0]); /* see comment below */
-        return true;
+        ent->uid  = field[fields->uid];
+        ent->name = field[fields->name];
       }
     }
-    
-    /*------------------------------------------------------------------
-    ; Some tight coupling between this routine and breakline().  The first
-    ; element of lines[] needs to be freed, but not the rest.
-    ;--------------------------------------------------------------------*/
-    
-    free(lines[0]);
   }
   
-  fclose(in);
-  return false;
+  return true;
+}
+
+/************************************************************************/
+
+bool authenticate_author(Blog const *blog,Request *req)
+{
+  struct authorent *ent;
+  char             *name;
+  
+  assert(blog        != NULL);
+  assert(req         != NULL);
+  assert(req->author != NULL);
+  
+  if (blog->config.author.file == NULL)
+    return strcmp(req->author,blog->config.author.name) == 0;
+    
+  if (!authors_load(blog->config.author.file,&blog->config.author.fields))
+    return false;
+    
+  ent = authors_find(req->author);
+  if (ent->uid == NULL)
+    return false;
+    
+  name = strdup(ent->name);
+  if (name == NULL)
+    return false;
+    
+  free(req->author);
+  req->author = name;
+  return true;
 }
 
 /**************************************************************************/
@@ -25,12 +25,17 @@
 #include <errno.h>
 
 #include <sys/stat.h>
+#include <sys/random.h>
+#include <dirent.h>
+#include <unistd.h>
 #include <syslog.h>
 
 #include <cgilib8/util.h>
 
 #include "blogutil.h"
 #include "backend.h"
+#include "stats.h"
+#include "search.h"
 
 /*****************************************************************/
 
@@ -159,15 +164,12 @@ static struct btm calculate_previous(Blog *blog,Request *request,struct btm cons
            
            while(btm_cmp(&previous,&blog->first) >= 0)
            {
-             BlogEntry *entry = BlogEntryRead(blog,&previous);
-             if (entry == NULL)
+             if (!BlogEntryExists(blog,&previous))
              {
                btm_dec_day(&previous);
                continue;
              }
              
-             assert(entry->valid);
-             BlogEntryFree(entry);
              return previous;
            }
            
@@ -185,15 +187,12 @@ static struct btm calculate_previous(Blog *blog,Request *request,struct btm cons
            
            while(btm_cmp(&previous,&blog->first) >= 0)
            {
-             BlogEntry *entry = BlogEntryRead(blog,&previous);
-             if (entry == NULL)
+             if (!BlogEntryExists(blog,&previous))
              {
                btm_dec_day(&previous);
                continue;
              }
              
-             assert(entry->valid);
-             BlogEntryFree(entry);
              return previous;
            }
            
@@ -210,15 +209,12 @@ static struct btm calculate_previous(Blog *blog,Request *request,struct btm cons
            
            while(btm_cmp(&previous,&blog->first) >= 0)
            {
-             BlogEntry *entry = BlogEntryRead(blog,&previous);
-             if (entry == NULL)
+             if (!BlogEntryExists(blog,&previous))
              {
                btm_dec_part(&previous);
                continue;
              }
              
-             assert(entry->valid);
-             BlogEntryFree(entry);
              return previous;
            }
            
@@ -259,15 +255,12 @@ static struct btm calculate_next(Blog *blog,Request *request,struct btm const en
            
            while(btm_cmp(&next,&blog->now) <= 0)
            {
-             BlogEntry *entry = BlogEntryRead(blog,&next);
-             if (entry == NULL)
+             if (!BlogEntryExists(blog,&next))
              {
                btm_inc_day(&next);
                continue;
              }
              
-             assert(entry->valid);
-             BlogEntryFree(entry);
              return next;
            }
            
@@ -285,15 +278,12 @@ static struct btm calculate_next(Blog *blog,Request *request,struct btm const en
            
            while(btm_cmp(&next,&blog->now) <= 0)
            {
-             BlogEntry *entry = BlogEntryRead(blog,&next);
-             if (entry == NULL)
+             if (!BlogEntryExists(blog,&next))
              {
                btm_inc_day(&next);
                continue;
              }
              
-             assert(entry->valid);
-             BlogEntryFree(entry);
              return next;
            }
            
@@ -310,16 +300,13 @@ static struct btm calculate_next(Blog *blog,Request *request,struct btm const en
            
            while(btm_cmp(&next,&blog->now) <= 0)
            {
-             BlogEntry *entry = BlogEntryRead(blog,&next);
-             if (entry == NULL)
+             if (!BlogEntryExists(blog,&next))
              {
                next.part = 1;
                btm_inc_day(&next);
                continue;
              }
              
-             assert(entry->valid);
-             BlogEntryFree(entry);
              return next;
            }
            request->f.navnext = false;
@@ -332,6 +319,111 @@ static struct btm calculate_next(Blog *blog,Request *request,struct btm const en
 
 /******************************************************************/
 
+static char *page_tumbler(struct btm const *start,struct btm const *stop)
+{
+  tumbler__s tum;
+  
+  assert(start != NULL);
+  assert(stop  != NULL);
+  
+  memset(&tum,0,sizeof(tum));
+  tum.start    = *start;
+  tum.stop     = *stop;
+  tum.ustart   = UNIT_PART;
+  tum.ustop    = UNIT_PART;
+  tum.segments = 4;
+  tum.range    = true;
+  return tumbler_canonical(&tum);
+}
+
+/******************************************************************/
+
+static void page_range(
+        Blog                 *blog,
+        Request              *request,
+        struct callback_data *cbd,
+        struct btm           *start,
+        struct btm           *end
+)
+{
+  BlogCursor cursor;
+  struct btm first;
+  struct btm last;
+  struct btm when;
+  struct btm prev;
+  size_t     count = 0;
+  
+  assert(blog                  != NULL);
+  assert(request               != NULL);
+  assert(cbd                   != NULL);
+  assert(start                 != NULL);
+  assert(end                   != NULL);
+  assert(blog->config.rangemax >  0);
+  
+  /*-----------------------------------------------------------------------
+  ; Cap a range to rangemax entries.  Each page links to its neighbors with
+  ; a range running from the first entry of that page to the far end of
+  ; the original request, so a page can be generated from its URL alone.
+  ; Going forward is easy, it's just the entry after this page.  Going back
+  ; means walking back up to rangemax entries from the start of this page.
+  ;------------------------------------------------------------------------*/
+  
+  request->f.navprev = false;
+  request->f.navnext = false;
+  
+  BlogCursorInit(&cursor,blog,start,end,request->f.reverse);
+  while((count < blog->config.rangemax) && BlogCursorNext(&cursor,&when))
+  {
+    if (count++ == 0)
+      first = when;
+    last = when;
+  }
+  
+  if (count == 0)
+    return;
+    
+  if (BlogCursorNext(&cursor,&when))
+  {
+    request->f.navnext = true;
+    cbd->next          = when;
+    cbd->nextpage      = page_tumbler(&when,request->f.reverse ? start : end);
+  }
+  
+  /*-----------------------------------------------------------------------
+  ; The previous page ends just before this one, so walk the other way from
+  ; the start of this page, no further than the original request goes (so
+  ; the first page of a request has no previous page).
+  ;------------------------------------------------------------------------*/
+  
+  if (request->f.reverse)
+    BlogCursorInit(&cursor,blog,&first,end,false);
+  else
+    BlogCursorInit(&cursor,blog,start,&first,true);
+    
+  BlogCursorNext(&cursor,&when); /* this page's first entry */
+  
+  for (count = 0 ; count < blog->config.rangemax ; count++)
+  {
+    if (!BlogCursorNext(&cursor,&when))
+      break;
+    prev = when;
+  }
+  
+  if (count > 0)
+  {
+    request->f.navprev = true;
+    cbd->previous      = prev;
+    cbd->prevpage      = page_tumbler(&prev,request->f.reverse ? start : end);
+  }
+  
+  if (request->f.reverse)
+    *start = last;
+  else
+    *end = last;
+}
+
+/******************************************************************/
+
 static int dstring_cmp(void const *needle,void const *haystack)
 {
   char const           *key   = needle;
@@ -558,7 +650,7 @@ static int display_file(
     char const  *type;
     int          rc;
     
-    rc = stat(fname,&status);
+    rc = stats_stat(fname,&status);
     if (rc == -1)
     {
       if (errno == ENOENT)
@@ -608,7 +700,7 @@ static int display_file(
         HttpTimeStamp(lastmod,sizeof(lastmod),status.st_mtime)
       );
       
-      fcopy(stdout,stdin);
+      stats_read(fcopy(stdout,stdin));
     }
     fclose(stdin);
   }
@@ -649,11 +741,38 @@ static char *tag_collect(List *list,char const *def)
 
 /********************************************************************/
 
+static size_t tag_random(size_t num)
+{
+  static bool seeded;
+  
+  assert(num > 0);
+  
+  /*------------------------------------------------------------------------
+  ; The generator is seeded once per process.  getrandom() doesn't need a
+  ; file to be opened, and if it fails (no entropy yet, or an old kernel)
+  ; the time and pid are good enough for picking an ad.
+  ;-----------------------------------------------------------------------*/
+  
+  if (!seeded)
+  {
+    unsigned int seed;
+    
+    if (getrandom(&seed,sizeof(seed),GRND_NONBLOCK) != sizeof(seed))
+      seed = (unsigned int)time(NULL) ^ (unsigned int)getpid();
+    srand(seed);
+    seeded = true;
+  }
+  
+  return (size_t)(((double)rand() / ((double)RAND_MAX + 1.0)) * (double)num);
+}
+
+/********************************************************************/
+
 static char *tag_pick(char const *tag,char const *def)
 {
-  String *pool;
-  size_t  num;
-  char   *pick;
+  static char   *cache;
+  static String *pool;
+  static size_t  num;
   
   assert(tag != NULL);
   assert(def != NULL);
@@ -661,7 +780,24 @@ static char *tag_pick(char const *tag,char const *def)
   if (empty_string(tag))
     return strdup(def);
     
-  pool = tag_split(&num,tag);
+  /*------------------------------------------------------------------------
+  ; Regenerating the pages picks an ad for each template, usually from the
+  ; same tags, so keep the last split around.
+  ;-----------------------------------------------------------------------*/
+  
+  if ((cache == NULL) || (strcmp(cache,tag) != 0))
+  {
+    free(pool);
+    free(cache);
+    cache = strdup(tag);
+    if (cache == NULL)
+    {
+      pool = NULL;
+      num  = 0;
+      return strdup(def);
+    }
+    pool = tag_split(&num,cache);
+  }
   
   /*------------------------------------------------------------------------
   ; if num is 0, then the tag string was malformed (basically, started with
@@ -670,27 +806,12 @@ static char *tag_pick(char const *tag,char const *def)
   
   if (num)
   {
-    unsigned int seed;
-    FILE         *fp;
-    size_t        r;
-    
-    fp = fopen("/dev/urandom","rb");
-    if (fp != NULL)
-    {
-      fread(&seed,sizeof(seed),1,fp);
-      fclose(fp);
-    }
-    srand(seed);
-    
-    r = (((double)rand() / (double)RAND_MAX) * (double)num);
+    size_t r = tag_random(num);
     assert(r < num);
-    pick = fromstring(pool[r]);
+    return fromstring(pool[r]);
   }
   else
-    pick = strdup(def);
-    
-  free(pool);
-  return pick;
+    return strdup(def);
 }
 
 /******************************************************************/
@@ -713,6 +834,71 @@ static void free_entries(List *list)
 
 /******************************************************************/
 
+static uint64_t template_stamp(char const *dir)
+{
+  DIR           *d;
+  struct dirent *de;
+  uint64_t       stamp = 0;
+  
+  assert(dir != NULL);
+  
+  /*-----------------------------------------------------------------------
+  ; The order readdir() returns files is unspecified, so the hashes for the
+  ; individual files are summed to make the result independent of order.
+  ;------------------------------------------------------------------------*/
+  
+  d = opendir(dir);
+  if (d == NULL)
+    return stamp;
+    
+  while((de = readdir(d)) != NULL)
+  {
+    char        fname[FILENAME_MAX];
+    struct stat status;
+    long long   fstamp[2];
+    
+    if (de->d_name[0] == '.')
+      continue;
+      
+    snprintf(fname,sizeof(fname),"%s/%s",dir,de->d_name);
+    if (stats_stat(fname,&status) < 0)
+      continue;
+      
+    fstamp[0] = status.st_mtime;
+    fstamp[1] = status.st_size;
+    stamp    += hash_mem(hash_mem(HASH_INIT,de->d_name,strlen(de->d_name)),fstamp,sizeof(fstamp));
+  }
+  
+  closedir(d);
+  return stamp;
+}
+
+/******************************************************************/
+
+static void page_etag(struct callback_data *cbd,uint64_t etag)
+{
+  uint64_t tstamp;
+  
+  assert(cbd != NULL);
+  
+  /*----------------------------------------------------------------------
+  ; The caller has already run the entries on the page (and their comments,
+  ; webmentions and ads) through BlogEntryStamp().  Add the template, and
+  ; the first, last and current dates, since the latter affect the
+  ; navigation links.
+  ;-----------------------------------------------------------------------*/
+  
+  tstamp = template_stamp(cbd->template->template);
+  etag   = hash_mem(etag,&tstamp,sizeof(tstamp));
+  etag   = hash_mem(etag,&cbd->blog->first,sizeof(struct btm));
+  etag   = hash_mem(etag,&cbd->blog->last,sizeof(struct btm));
+  etag   = hash_mem(etag,&cbd->blog->now,sizeof(struct btm));
+  
+  cbd->etag = etag ? etag : 1;
+}
+
+/******************************************************************/
+
 struct callback_data *callback_init(struct callback_data *cbd,Blog *blog,Request const *request)
 {
   assert(cbd     != NULL);
@@ -720,6 +906,7 @@ struct callback_data *callback_init(struct callback_data *cbd,Blog *blog,Request
   assert(request != NULL);
   
   ListInit(&cbd->list);
+  cbd->cursor   = NULL;
   cbd->entry    = NULL;
   cbd->ad       = NULL;
   cbd->adtag    = NULL;
@@ -727,8 +914,13 @@ struct callback_data *callback_init(struct callback_data *cbd,Blog *blog,Request
   cbd->wm       = NULL;
   cbd->wmtitle  = NULL;
   cbd->wmurl    = NULL;
+  cbd->prevpage = NULL;
+  cbd->nextpage = NULL;
+  cbd->summary  = NULL;
+  cbd->prefix   = NULL;
   cbd->navunit  = UNIT_PART;
   cbd->status   = HTTP_OKAY;
+  cbd->etag     = 0;
   cbd->template = &blog->config.templates[0]; /* XXX probably document this */
   cbd->request  = request;
   cbd->blog     = blog;
@@ -749,6 +941,8 @@ pagegen__f TO_pagegen(char const *name)
     return pagegen_items;
   else if (strcmp(name,"days") == 0)
     return pagegen_days;
+  else if (strcmp(name,"class") == 0)
+    return pagegen_class;
   else
   {
     assert(0);
@@ -762,6 +956,8 @@ int generate_thisday(Blog *blog,Request *request,FILE *out,struct btm when)
 {
   struct callback_data  cbd;
   char                 *tags;
+  struct btm           *days;
+  size_t                num;
   
   assert(blog    != NULL);
   assert(request != NULL);
@@ -769,24 +965,40 @@ int generate_thisday(Blog *blog,Request *request,FILE *out,struct btm when)
   
   callback_init(&cbd,blog,request);
   
-  for(when.year = blog->first.year ; when.year <= blog->now.year ; when.year++)
+  /*----------------------------------------------------------------------
+  ; The index lists just the entries posted on this month and day, so only
+  ; those are looked at.  A conditional GET can be answered from the stat()
+  ; data alone, before any of the entries are read in.
+  ;-----------------------------------------------------------------------*/
+  
+  num = BlogThisDay(blog,&when,&days);
+  
+  if (request->f.cgiget)
   {
-    if (btm_cmp_date(&when,&blog->first) < 0)
-      continue;
+    uint64_t etag = HASH_INIT;
+    
+    for (size_t i = 0 ; i < num ; i++)
+      BlogEntryStamp(blog,&days[i],&etag);
       
-    for (when.part = 1 ; ; when.part++)
+    page_etag(&cbd,etag);
+    if (generic_not_modified(out,&cbd))
     {
-      BlogEntry *entry = BlogEntryRead(blog,&when);
-      if (entry)
-      {
-        assert(entry->valid);
-        ListAddTail(&cbd.list,&entry->node);
-      }
-      else
-        break;
+      free(days);
+      return 0;
     }
   }
   
+  for (size_t i = 0 ; i < num ; i++)
+  {
+    BlogEntry *entry = BlogEntryRead(blog,&days[i]);
+    if (entry)
+    {
+      assert(entry->valid);
+      ListAddTail(&cbd.list,&entry->node);
+    }
+  }
+  
+  free(days);
   tags = tag_collect(&cbd.list,blog->config.adtag);
   cbd.adtag = tag_pick(tags,blog->config.adtag);
   free(tags);
@@ -798,43 +1010,169 @@ int generate_thisday(Blog *blog,Request *request,FILE *out,struct btm when)
 
 /************************************************************************/
 
-int generate_pages(Blog *blog,Request *request)
+static void page_generate(Blog *blog,Request *request,template__t const *template)
 {
-  assert(blog    != NULL);
-  assert(request != NULL);
+  FILE  *out;
+  int  (*pagegen)(Blog *,Request *,struct template const *,FILE *);
   
-  for (size_t i = 0 ; i < blog->config.templatenum ; i++)
+  assert(blog     != NULL);
+  assert(request  != NULL);
+  assert(template != NULL);
+  
+  out = stats_fopen(template->file,"w");
+  if (out == NULL)
+  {
+    syslog(LOG_ERR,"%s: %s",template->file,strerror(errno));
+    return;
+  }
+  
+  pagegen = TO_pagegen(template->pagegen);
+  (*pagegen)(blog,request,template,out);
+  stats_written(ftell(out));
+  stats_start(STAGE_OUTPUT);
+  fclose(out);
+  stats_stop(STAGE_OUTPUT);
+  
+  if (template->posthook)
+  {
+    char const *argv[4];
+    
+    argv[0] = template->posthook;
+    argv[1] = template->file;
+    argv[2] = request->f.regenerate ? "regenerate" : "new";
+    argv[3] = NULL;
+    
+    queue_hook(blog->config.hookspool,"template-post-hook",argv);
+  }
+}
+
+/************************************************************************/
+
+static void class_pages(Blog *blog,Request *request,template__t const *template)
+{
+  char        **tags;
+  size_t        num;
+  char const   *p;
+  
+  assert(blog     != NULL);
+  assert(request  != NULL);
+  assert(template != NULL);
+  
+  /*----------------------------------------------------------------------
+  ; A "class" template makes a page per class tag, the output naming the
+  ; file with a %s for the tag (checked when the configuration was read),
+  ; escaped by BlogClassName(), so no two tags ("C" and "C++", say) end up
+  ; sharing a page.  Only the tags of a new entry need to be done, unless
+  ; everything is being regenerated---or an edit dropped some tags, as
+  ; their pages still list the entry.
+  ;-----------------------------------------------------------------------*/
+  
+  if (request->f.regenerate)
+    num = BlogClassTags(blog,&tags);
+  else
   {
-    FILE  *out = fopen(blog->config.templates[i].file,"w");
-    int  (*pagegen)(Blog *,Request *,struct template const *,FILE *);
+    String *split;
+    String *oldsplit;
+    size_t  numnew = 0;
+    size_t  numold = 0;
     
-    if (out == NULL)
+    num      = 0;
+    tags     = NULL;
+    split    = request->class    != NULL ? tag_split(&numnew,request->class)    : NULL;
+    oldsplit = request->oldclass != NULL ? tag_split(&numold,request->oldclass) : NULL;
+    
+    if (numnew + numold > 0)
     {
-      syslog(LOG_ERR,"%s: %s",blog->config.templates[i].file,strerror(errno));
-      continue;
+      tags = malloc((numnew + numold) * sizeof(char *));
+      if (tags != NULL)
+      {
+        for (size_t i = 0 ; i < numnew ; i++)
+          tags[num++] = fromstring(split[i]);
+        for (size_t i = 0 ; i < numold ; i++)
+          tags[num++] = fromstring(oldsplit[i]);
+      }
     }
     
-    pagegen = TO_pagegen(blog->config.templates[i].pagegen);
-    (*pagegen)(blog,request,&blog->config.templates[i],out);
-    fclose(out);
+    free(oldsplit);
+    free(split);
+  }
+  
+  p = strstr(template->file,"%s");
+  assert(p != NULL);
+  
+  for (size_t i = 0 ; i < num ; i++)
+  {
+    template__t page = *template;
+    char        file[FILENAME_MAX];
+    char        name[FILENAME_MAX];
+    bool        done = false;
+    
+    if (tags[i] == NULL)
+      continue;
+      
+    BlogClassName(name,sizeof(name),tags[i]);
     
-    if (blog->config.templates[i].posthook)
+    /*---------------------------------------------------------------------
+    ; A tag kept through an edit is in both lists, and tags differing only
+    ; in case share a page, so skip a name that's already been done (the
+    ; tags from the index are already unique).
+    ;----------------------------------------------------------------------*/
+    
+    for (size_t j = 0 ; !request->f.regenerate && !done && (j < i) ; j++)
     {
-      char const *argv[4];
+      char prev[FILENAME_MAX];
       
-      argv[0] = blog->config.templates[i].posthook;
-      argv[1] = blog->config.templates[i].file;
-      argv[2] = request->f.regenerate ? "regenerate" : "new";
-      argv[3] = NULL;
+      if (tags[j] == NULL)
+        continue;
+      BlogClassName(prev,sizeof(prev),tags[j]);
+      done = strcmp(prev,name) == 0;
+    }
+    
+    if (done || (*name == '\0'))
+      continue;
       
-      run_hook("template-post-hook",argv);
+    if ((size_t)snprintf(
+                  file,
+                  sizeof(file),
+                  "%.*s%s%s",
+                  (int)(p - template->file),
+                  template->file,
+                  name,
+                  p + 2
+                ) >= sizeof(file))
+      syslog(LOG_ERR,"%s: name too long for class '%s'",template->file,tags[i]);
+    else
+    {
+      page.file  = file;
+      page.class = tags[i];
+      page_generate(blog,request,&page);
     }
   }
   
+  for (size_t i = 0 ; i < num ; i++)
+    free(tags[i]);
+  free(tags);
+}
+
+/************************************************************************/
+
+int generate_pages(Blog *blog,Request *request)
+{
+  assert(blog    != NULL);
+  assert(request != NULL);
+  
+  for (size_t i = 0 ; i < blog->config.templatenum ; i++)
+  {
+    if (strcmp(blog->config.templates[i].pagegen,"class") == 0)
+      class_pages(blog,request,&blog->config.templates[i]);
+    else
+      page_generate(blog,request,&blog->config.templates[i]);
+  }
+  
   return 0;
 }
 
-/******************************************************************/
+/************************************************************************/
 
 int pagegen_items(
         Blog              *blog,
@@ -876,6 +1214,62 @@ int pagegen_items(
 
 /************************************************************************/
 
+int pagegen_class(
+        Blog              *blog,
+        Request           *request,
+        template__t const *template,
+        FILE              *out
+)
+{
+  struct btm           *hits;
+  size_t                num;
+  size_t                first;
+  char                 *tags;
+  struct callback_data  cbd;
+  
+  assert(blog     != NULL);
+  assert(request  != NULL);
+  assert(template != NULL);
+  assert(out      != NULL);
+  
+  /*----------------------------------------------------------------------
+  ; The latest items entries with the tag, straight from the class index.
+  ;-----------------------------------------------------------------------*/
+  
+  request->f.fullurl = template->fullurl;
+  request->f.reverse = template->reverse;
+  
+  callback_init(&cbd,blog,request);
+  cbd.template = template;
+  
+  num   = template->class != NULL ? BlogClassEntries(blog,template->class,&hits) : 0;
+  first = num > template->items ? num - template->items : 0;
+  
+  for (size_t i = first ; i < num ; i++)
+  {
+    BlogEntry *entry = BlogEntryRead(blog,&hits[template->reverse ? num - 1 - (i - first) : i]);
+    if (entry)
+    {
+      assert(entry->valid);
+      ListAddTail(&cbd.list,&entry->node);
+    }
+  }
+  
+  if (template->class != NULL)
+    free(hits);
+    
+  tags      = tag_collect(&cbd.list,blog->config.adtag);
+  cbd.adtag = tag_pick(tags,blog->config.adtag);
+  
+  free(tags);
+  generic_main(out,&cbd);
+  free_entries(&cbd.list);
+  free(cbd.adtag);
+  return 0;
+}
+
+/************************************************************************/
+
 int pagegen_days(
         Blog              *blog,
         Request           *request,
@@ -938,9 +1332,154 @@ int pagegen_days(
 
 /************************************************************************/
 
+int generate_overview(
+        Blog        *blog,
+        Request     *request,
+        char const  *prefix,
+        int        (*errorf)(Blog *,Request *,int,char const *,...)
+)
+{
+  struct callback_data cbd;
+  size_t               size;
+  
+  assert(blog    != NULL);
+  assert(request != NULL);
+  assert(errorf);
+  
+  /*----------------------------------------------------------------------
+  ; The prefix limits the overview to a year (YYYY) or month (YYYY/MM).
+  ;-----------------------------------------------------------------------*/
+  
+  if ((prefix != NULL) && (strspn(prefix,"0123456789/") != strlen(prefix)))
+    return (*errorf)(blog,request,HTTP_BADREQ,"bad date");
+    
+  callback_init(&cbd,blog,request);
+  cbd.navunit = UNIT_MONTH;
+  cbd.prefix  = prefix;
+  cbd.summary = BlogSummaryRead(blog,&size);
+  
+  if (cbd.summary == NULL)
+    return (*errorf)(blog,request,HTTP_ISERVERERR,"overview not available");
+    
+  generic_main(stdout,&cbd);
+  free(cbd.summary);
+  return 0;
+}
+
+/************************************************************************/
+
+static int hits_page(Blog *blog,Request *request,struct btm const *hits,size_t num)
+{
+  struct callback_data  cbd;
+  char                 *tags;
+  
+  assert(blog    != NULL);
+  assert(request != NULL);
+  assert((hits != NULL) || (num == 0));
+  
+  /*----------------------------------------------------------------------
+  ; The hits from an index are rendered in the order given, and limited
+  ; like a range of entries is.
+  ;-----------------------------------------------------------------------*/
+  
+  if ((blog->config.rangemax > 0) && (num > blog->config.rangemax))
+    num = blog->config.rangemax;
+    
+  callback_init(&cbd,blog,request);
+  
+  for (size_t i = 0 ; i < num ; i++)
+  {
+    BlogEntry *entry = BlogEntryRead(blog,&hits[i]);
+    if (entry)
+    {
+      assert(entry->valid);
+      ListAddTail(&cbd.list,&entry->node);
+    }
+  }
+  
+  tags      = tag_collect(&cbd.list,blog->config.adtag);
+  cbd.adtag = tag_pick(tags,blog->config.adtag);
+  free(tags);
+  generic_main(stdout,&cbd);
+  free_entries(&cbd.list);
+  free(cbd.adtag);
+  return 0;
+}
+
+/************************************************************************/
+
+int generate_search(
+        Blog        *blog,
+        Request     *request,
+        char const  *query,
+        int        (*errorf)(Blog *,Request *,int,char const *,...)
+)
+{
+  struct btm *hits;
+  size_t      num;
+  int         rc;
+  
+  assert(blog    != NULL);
+  assert(request != NULL);
+  assert(query   != NULL);
+  assert(errorf);
+  
+  if (!search_query(blog,query,&hits,&num))
+    return (*errorf)(blog,request,HTTP_ISERVERERR,"search not available");
+    
+  rc = hits_page(blog,request,hits,num);
+  free(hits);
+  return rc;
+}
+
+/************************************************************************/
+
+int generate_class(
+        Blog        *blog,
+        Request     *request,
+        char const  *class,
+        int        (*errorf)(Blog *,Request *,int,char const *,...)
+)
+{
+  struct btm *hits;
+  size_t      num;
+  int         rc;
+  
+  assert(blog    != NULL);
+  assert(request != NULL);
+  assert(class   != NULL);
+  assert(errorf);
+  
+  num = BlogClassEntries(blog,class,&hits);
+  if (num == 0)
+  {
+    free(hits);
+    return (*errorf)(blog,request,HTTP_NOTFOUND,"%s: no such class",class);
+  }
+  
+  /*----------------------------------------------------------------------
+  ; The index is in order, and the latest entries are wanted first.
+  ;-----------------------------------------------------------------------*/
+  
+  for (size_t i = 0 ; i < num / 2 ; i++)
+  {
+    struct btm tmp    = hits[i];
+    hits[i]           = hits[num - 1 - i];
+    hits[num - 1 - i] = tmp;
+  }
+  
+  rc = hits_page(blog,request,hits,num);
+  free(hits);
+  return rc;
+}
+
+/************************************************************************/
+
 int tumbler_page(Blog *blog,Request *request,tumbler__s *spec,int (*errorf)(Blog *,Request *,int,char const *,...))
 {
   struct callback_data cbd;
+  BlogCursor           cursor;
+  BlogEntry           *entry;
   struct btm           start;
   struct btm           end;
   char                *tags;
@@ -977,26 +1516,13 @@ int tumbler_page(Blog *blog,Request *request,tumbler__s *spec,int (*errorf)(Blog
   start = spec->start;
   end   = spec->stop;
   
-  if (!spec->range)
+  if (spec->range && (btm_cmp(&spec->start,&spec->stop) > 0))
   {
-    request->f.navigation = true;
-    cbd.navunit  = spec->ustart > spec->ustop
-                 ? spec->ustart
-                 : spec->ustop
-                 ;
-    cbd.previous = calculate_previous(blog,request,start,cbd.navunit);
-    cbd.next     = calculate_next(blog,request,end,cbd.navunit);
-  }
-  else
-  {
-    if (btm_cmp(&spec->start,&spec->stop) > 0)
-    {
-      tumbler__s newtum = *spec;
-      swap_endpoints(&newtum);
-      start              = newtum.start;
-      end                = newtum.stop;
-      request->f.reverse = true;
-    }
+    tumbler__s newtum = *spec;
+    swap_endpoints(&newtum);
+    start              = newtum.start;
+    end                = newtum.stop;
+    request->f.reverse = true;
   }
   
   assert(end.day <= max_monthday(end.year,end.month));
@@ -1020,29 +1546,76 @@ int tumbler_page(Blog *blog,Request *request,tumbler__s *spec,int (*errorf)(Blog
   
   assert(btm_cmp(&start,&end) <= 0);
   
+  if (spec->range && (blog->config.rangemax > 0))
+  {
+    page_range(blog,request,&cbd,&start,&end);
+    request->f.navigation = request->f.navprev || request->f.navnext;
+  }
+  
+  /*-----------------------------------------------------------------------
+  ; Before reading anything in, see if the client already has this page.
+  ; Finding the entries, and the freshness of them, only needs stat() data.
+  ;------------------------------------------------------------------------*/
+  
+  if (request->f.cgiget)
+  {
+    struct btm when;
+    uint64_t   etag = HASH_INIT;
+    
+    BlogCursorInit(&cursor,blog,&start,&end,request->f.reverse);
+    while(BlogCursorNext(&cursor,&when))
+      BlogEntryStamp(blog,&when,&etag);
+      
+    page_etag(&cbd,etag);
+    if (generic_not_modified(stdout,&cbd))
+    {
+      free(cbd.prevpage);
+      free(cbd.nextpage);
+      return 0;
+    }
+  }
+  
+  if (!spec->range)
+  {
+    request->f.navigation = true;
+    cbd.navunit  = spec->ustart > spec->ustop
+                 ? spec->ustart
+                 : spec->ustop
+                 ;
+    cbd.previous = calculate_previous(blog,request,start,cbd.navunit);
+    cbd.next     = calculate_next(blog,request,end,cbd.navunit);
+  }
+  
   /*-------------------------------------------------------------------------
   ; okay, resume processing ...  bound against the starting time of the
   ; blog, and the current time.
   ;
-  ; From here on out, it's pretty straight forward.  read a day, if it has
-  ; entries, add it to the list, otherwise, continue on, advancing (or
-  ; retreading) the days as we go ...
-  ;
-  ; these four lines replaced 65 very confused lines of code.
+  ; Only the first entry is read in here---the page title is based off it.
+  ; The rest are read in (and freed) by the template callbacks as they're
+  ; rendered, so a range of twenty years takes no more memory than a single
+  ; day.  The ad tag is still picked from the class tags of every entry on
+  ; the page, which only takes reading the class file of each day.
   ;-----------------------------------------------------------*/
   
-  if (request->f.reverse)
-    BlogEntryReadBetweenD(blog,&cbd.list,&end,&start);
+  BlogCursorInit(&cursor,blog,&start,&end,request->f.reverse);
+  entry = BlogCursorRead(&cursor);
+  if (entry != NULL)
+    ListAddTail(&cbd.list,&entry->node);
+  cbd.cursor = &cursor;
+  
+  if ((entry != NULL) && !empty_string(entry->adtag))
+    tags = strdup(entry->adtag);
   else
-    BlogEntryReadBetweenU(blog,&cbd.list,&start,&end);
+    tags = BlogClassesBetween(blog,&start,&end);
     
-  tags      = tag_collect(&cbd.list,blog->config.adtag);
-  cbd.adtag = tag_pick(tags,blog->config.adtag);
+  cbd.adtag = tag_pick(tags != NULL ? tags : "",blog->config.adtag);
   
   free(tags);
   generic_main(stdout,&cbd);
   free_entries(&cbd.list);
   free(cbd.adtag);
+  free(cbd.prevpage);
+  free(cbd.nextpage);
   return 0;
 }
 
@@ -24,6 +24,7 @@
 #define I_5B8ED10A_F8F4_5F83_A7EA_CD76EE7A05D8
 
 #include <stdio.h>
+#include <stdint.h>
 
 #include "frontend.h"
 #include "blog.h"
@@ -35,6 +36,7 @@ typedef int (*pagegen__f)(Blog *,Request *,struct template const *,FILE *);
 struct callback_data
 {
   List               list;
+  BlogCursor        *cursor;   /* entries yet to be read, or NULL */
   BlogEntry         *entry;    /* current entry being processed */
   FILE              *ad;       /* file containing ad            */
   char              *adtag;
@@ -45,8 +47,13 @@ struct callback_data
   struct btm         last;     /* timestamp of previous entry   */
   struct btm         previous;
   struct btm         next;
+  char              *prevpage; /* range tumbler of previous page */
+  char              *nextpage; /* range tumbler of next page     */
+  char              *summary;  /* entry summary, for overview    */
+  char const        *prefix;   /* date prefix to limit overview */
   unit__e            navunit;
   http__e            status;
+  uint64_t           etag;     /* 0 if no ETag for the page     */
   template__t const *template;
   Request     const *request;
   Blog              *blog;
@@ -60,10 +67,18 @@ extern int                   generate_thisday (Blog *,Request *,FILE *,struct bt
 extern int                   generate_pages   (Blog *,Request *);
 extern int                   pagegen_items    (Blog *,Request *,template__t const *,FILE *);
 extern int                   pagegen_days     (Blog *,Request *,template__t const *,FILE *);
+extern int                   pagegen_class    (Blog *,Request *,template__t const *,FILE *);
 extern int                   tumbler_page     (Blog *,Request *,tumbler__s *,int (*)(Blog *,Request *,int,char const *,...));
+extern int                   generate_overview(Blog *,Request *,char const *,int (*)(Blog *,Request *,int,char const *,...));
+extern int                   generate_search  (Blog *,Request *,char const *,int (*)(Blog *,Request *,int,char const *,...));
+extern int                   generate_class   (Blog *,Request *,char const *,int (*)(Blog *,Request *,int,char const *,...));
 extern void                  generic_cb       (char const *,FILE *,void *);
+extern bool                  generic_not_modified(FILE *,struct callback_data *);
 extern void                  generic_main     (FILE *,struct callback_data *);
 extern bool                  run_hook         (char const *,char const *[]);
+extern bool                  run_hook_fds     (char const *,char const *[],int const [],size_t);
+extern bool                  queue_hook       (char const *,char const *,char const *[]);
+extern int                   run_hooks        (char const *,size_t,size_t,bool);
 extern int                   mailfile_readdata(Blog *,Request *);
 
 #endif
@@ -24,11 +24,14 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <locale.h>
+#include <ctype.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
 #include <syslog.h>
 
 #include <lualib.h>
@@ -36,6 +39,9 @@
 
 #include "blog.h"
 #include "wbtum.h"
+#include "blogutil.h"
+#include "stats.h"
+#include "search.h"
 
 /***********************************************************************/
 
@@ -55,10 +61,10 @@ static bool set_date(char const *file,struct btm *when,struct btm *now)
   assert(when != NULL);
   assert(now  != NULL);
   
-  FILE *fp = fopen(file,"r");
+  FILE *fp = stats_fopen(file,"r");
   if (fp == NULL)
   {
-    fp = fopen(file,"w");
+    fp = stats_fopen(file,"w");
     if (fp != NULL)
     {
       *when = *now;
@@ -160,6 +166,22 @@ static void blog_unlock(char const *lockfile,int lock)
 
 /***********************************************************************/
 
+int BlogLock(Blog *blog)
+{
+  assert(blog != NULL);
+  return blog_lock(blog->config.lockfile);
+}
+
+/***********************************************************************/
+
+void BlogUnlock(Blog *blog,int lock)
+{
+  assert(blog != NULL);
+  blog_unlock(blog->config.lockfile,lock);
+}
+
+/***********************************************************************/
+
 static void date_to_dir(char *tname,struct btm const *date)
 {
   assert(tname != NULL);
@@ -201,9 +223,9 @@ static FILE *open_file_r(char const *name,struct btm const *date)
   assert(date != NULL);
   
   date_to_filename(buffer,date,name);
-  in = fopen(buffer,"r");
+  in = stats_fopen(buffer,"r");
   if (in == NULL)
-    in = fopen("/dev/null","r");
+    in = stats_fopen("/dev/null","r");
     
   /*----------------------------------------------------------------------
   ; because the code was written using a different IO model (that is, if
@@ -226,7 +248,7 @@ static FILE *open_file_w(char const *name,struct btm const *date)
   assert(date != NULL);
   
   date_to_filename(buffer,date,name);
-  out = fopen(buffer,"w");
+  out = stats_fopen(buffer,"w");
   return out;
 }
 
@@ -239,7 +261,7 @@ static bool date_check(struct btm const *date)
   
   assert(date != NULL);
   date_to_dir(tname,date);
-  return stat(tname,&status) == 0;
+  return stats_stat(tname,&status) == 0;
 }
 
 /************************************************************************/
@@ -253,7 +275,7 @@ static int date_checkcreate(struct btm const *date)
   assert(date != NULL);
   
   snprintf(tname,sizeof(tname),"%04d",date->year);
-  rc = stat(tname,&status);
+  rc = stats_stat(tname,&status);
   if (rc != 0)
   {
     if (errno != ENOENT)
@@ -264,7 +286,7 @@ static int date_checkcreate(struct btm const *date)
   }
   
   snprintf(tname,sizeof(tname),"%04d/%02d",date->year,date->month);
-  rc = stat(tname,&status);
+  rc = stats_stat(tname,&status);
   if (rc != 0)
   {
     if (errno != ENOENT)
@@ -275,7 +297,7 @@ static int date_checkcreate(struct btm const *date)
   }
   
   snprintf(tname,sizeof(tname),"%04d/%02d/%02d",date->year,date->month,date->day);
-  rc = stat(tname,&status);
+  rc = stats_stat(tname,&status);
   if (rc != 0)
   {
     if (errno != ENOENT)
@@ -314,6 +336,7 @@ static char *blog_meta_entry(char const *name,struct btm const *date)
       free(text);
       return strdup("");
     }
+    stats_read(bytes);
   }
   
   fclose(fp);
@@ -374,6 +397,7 @@ static size_t blog_meta_read(
       free(lines[i]);
       break;
     }
+    stats_read(bytes);
     nl = strchr(lines[i],'\n');
     if (nl) *nl = '\0';
   }
@@ -422,6 +446,7 @@ static int blog_meta_write(
   for (size_t i = 0 ; i < num ; i++)
     fprintf(fp,"%s\n",list[i]);
     
+  stats_written(ftell(fp));
   fclose(fp);
   return 0;
 }
@@ -592,7 +617,23 @@ static size_t confL_totemplates(lua_State *L,int idx,template__t *ptemps[])
     temps[i].fullurl = lua_toboolean(L,-1);
     lua_getfield(L,tidx,"posthook");
     temps[i].posthook = luaL_optstring(L,-1,NULL);
-    lua_pop(L,7);
+    lua_getfield(L,tidx,"class");
+    if (lua_toboolean(L,-1))
+    {
+      char const *p = strstr(temps[i].file,"%s");
+      
+      /*-------------------------------------------------------------------
+      ; The tag replaces the one %s in the output name; anything else with
+      ; a '%' is a mistake, and no %s at all would put every tag into the
+      ; one file.
+      ;--------------------------------------------------------------------*/
+      
+      if ((p == NULL) || (strchr(temps[i].file,'%') != p) || (strchr(p + 2,'%') != NULL))
+        return luaL_error(L,"template output '%s' needs exactly one %%s for a class",temps[i].file);
+      temps[i].pagegen = "class";
+    }
+    temps[i].class = NULL;
+    lua_pop(L,8);
   }
   
   *ptemps = temps;
@@ -648,9 +689,61 @@ static size_t confL_toaffiliates(lua_State *L,int idx,aflink__t *paffs[])
 
 /***************************************************************************/
 
+static void confL_hashaffiliates(lua_State *L,struct config *config)
+{
+  size_t size;
+  
+  assert(L      != NULL);
+  assert(config != NULL);
+  
+  /*-----------------------------------------------------------------------
+  ; An open addressed table, at most half full, keyed by the protocol.  A
+  ; protocol listed twice goes to the first one, as with the linear search
+  ; this replaces.
+  ;------------------------------------------------------------------------*/
+  
+  config->afhash     = NULL;
+  config->afhashsize = 0;
+  
+  if (config->affiliatenum == 0)
+    return;
+    
+  for (size = 4 ; size < config->affiliatenum * 2 ; size *= 2)
+    ;
+    
+  config->afhash = lua_newuserdata(L,size * sizeof(aflink__t *));
+  luaL_ref(L,LUA_REGISTRYINDEX); /* prevent GC reclaiming this memory */
+  memset(config->afhash,0,size * sizeof(aflink__t *));
+  config->afhashsize = size;
+  
+  for (size_t i = 0 ; i < config->affiliatenum ; i++)
+  {
+    aflink__t *aff = &config->affiliates[i];
+    size_t     h   = hash_mem(HASH_INIT,aff->proto,aff->psize) & (size - 1);
+    
+    while(config->afhash[h] != NULL)
+    {
+      if (
+              (config->afhash[h]->psize == aff->psize)
+           && (memcmp(config->afhash[h]->proto,aff->proto,aff->psize) == 0)
+         )
+        break;
+      h = (h + 1) & (size - 1);
+    }
+    
+    if (config->afhash[h] == NULL)
+      config->afhash[h] = aff;
+  }
+}
+
+/***************************************************************************/
+
 static int confL_config(lua_State *L)
 {
-  size_t urllen;
+  size_t      urllen;
+  lua_Integer hookjobs;
+  lua_Integer hookretries;
+  lua_Integer rangemax;
   
   assert(L != NULL);
   
@@ -677,12 +770,26 @@ static int confL_config(lua_State *L)
   config->prehook = luaL_optstring(L,-1,NULL);
   lua_getglobal(L,"posthook");
   config->posthook = luaL_optstring(L,-1,NULL);
+  lua_getglobal(L,"hookspool");
+  config->hookspool = luaL_optstring(L,-1,NULL);
+  lua_getglobal(L,"hookjobs");
+  hookjobs = luaL_optinteger(L,-1,4);
+  config->hookjobs = hookjobs > 0 ? (size_t)hookjobs : 1;
+  lua_getglobal(L,"hookretries");
+  hookretries = luaL_optinteger(L,-1,5);
+  config->hookretries = hookretries > 0 ? (size_t)hookretries : 1;
+  lua_getglobal(L,"stats");
+  config->stats = luaL_optstring(L,-1,NULL);
+  lua_getglobal(L,"rangemax");
+  rangemax = luaL_optinteger(L,-1,100);
+  config->rangemax = rangemax > 0 ? (size_t)rangemax : 0;
   lua_getglobal(L,"author");
   confL_toauthor(L,-1,&config->author);
   lua_getglobal(L,"templates");
   config->templatenum = confL_totemplates(L,-1,&config->templates);
   lua_getglobal(L,"affiliate");
   config->affiliatenum = confL_toaffiliates(L,-1,&config->affiliates);
+  confL_hashaffiliates(L,config);
   
   /*--------------------------------------
   ; ensure that the URL ends with a '/'.
@@ -791,12 +898,17 @@ Blog *BlogNew(char const *configfile)
     return NULL;
   }
   
+  stats_start(STAGE_CONFIG);
   if (!config_read(configfile,blog))
   {
+    stats_stop(STAGE_CONFIG);
     BlogFree(blog);
     return NULL;
   }
   
+  stats_stop(STAGE_CONFIG);
+  stats_output(blog->config.stats);
+  
   umask(022);
   if (chdir(blog->config.basedir) != 0)
   {
@@ -866,6 +978,8 @@ BlogEntry *BlogEntryNew(Blog *blog)
     pbe->status       = NULL;
     pbe->adtag        = NULL;
     pbe->body         = NULL;
+    pbe->classes      = NULL;
+    pbe->classnum     = 0;
   }
   
   return pbe;
@@ -889,13 +1003,15 @@ BlogEntry *BlogEntryRead(Blog *blog,struct btm const *which)
     return NULL;
     
   date_to_part(pname,which,which->part);
-  if (access(pname,R_OK) != 0)
+  if (stats_access(pname,R_OK) != 0)
     return NULL;
     
   entry = malloc(sizeof(struct blogentry));
   if (entry == NULL)
     return NULL;
     
+  stats_start(STAGE_READ);
+  
   entry->node.ln_Succ = NULL;
   entry->node.ln_Pred = NULL;
   entry->valid        = true;
@@ -909,23 +1025,26 @@ BlogEntry *BlogEntryRead(Blog *blog,struct btm const *which)
   entry->author       = blog_meta_entry("authors",which);
   entry->status       = blog_meta_entry("status",which);
   entry->adtag        = blog_meta_entry("adtag",which);
+  entry->classes      = NULL;
+  entry->classnum     = 0;
   
-  if (stat(pname,&status) == 0)
+  if (stats_stat(pname,&status) == 0)
     entry->timestamp = status.st_mtime;
   else
     entry->timestamp = blog->tnow;
     
-  sinbody = fopen(pname,"r");
+  sinbody = stats_fopen(pname,"r");
   if (sinbody == NULL)
     entry->body = strdup("");
   else
   {
     entry->body = malloc(status.st_size + 1);
-    fread(entry->body,1,status.st_size,sinbody);
+    stats_read(fread(entry->body,1,status.st_size,sinbody));
     fclose(sinbody);
     entry->body[status.st_size] = '\0';
   }
   
+  stats_stop(STAGE_READ);
   return entry;
 }
 
@@ -938,68 +1057,41 @@ void BlogEntryReadBetweenU(
         struct btm const *restrict end
 )
 {
+  BlogCursor  cursor;
   BlogEntry  *entry;
-  struct btm  current;
   
   assert(blog  != NULL);
   assert(list  != NULL);
   assert(start != NULL);
   assert(end   != NULL);
   
-  current = *start;
+  BlogCursorInit(&cursor,blog,start,end,false);
   
-  while(btm_cmp(&current,end) <= 0)
-  {
-    entry = BlogEntryRead(blog,&current);
-    if (entry != NULL)
-    {
-      if (entry->timestamp > blog->lastmod)
-        blog->lastmod = entry->timestamp;
-      ListAddTail(list,&entry->node);
-      current.part++;
-    }
-    else
-    {
-      current.part = 1;
-      btm_inc_day(&current);
-    }
-  }
+  while((entry = BlogCursorRead(&cursor)) != NULL)
+    ListAddTail(list,&entry->node);
 }
 
 /************************************************************************/
 
 void BlogEntryReadBetweenD(
         Blog             *blog,
-        List             *listb,
+        List             *list,
         struct btm const *restrict end,
         struct btm const *restrict start
 )
 {
-  List  lista;
+  BlogCursor  cursor;
+  BlogEntry  *entry;
   
   assert(blog  != NULL);
-  assert(listb != NULL);
+  assert(list  != NULL);
   assert(start != NULL);
   assert(end   != NULL);
   
-  ListInit(&lista);
-  
-  /*----------------------------------------------
-  ; we read in the entries from earlier to later,
-  ; then just reverse the list.
-  ;----------------------------------------------*/
-  
-  BlogEntryReadBetweenU(blog,&lista,start,end);
+  BlogCursorInit(&cursor,blog,start,end,true);
   
-  for
-  (
-    Node *node = ListRemHead(&lista);
-    NodeValid(node);
-    node = ListRemHead(&lista)
-  )
-  {
-    ListAddHead(listb,node);
-  }
+  while((entry = BlogCursorRead(&cursor)) != NULL)
+    ListAddTail(list,&entry->node);
 }
 
 /*******************************************************************/
@@ -1080,161 +1172,1913 @@ void BlogEntryReadXU(
 
 /**************************************************************************/
 
-int BlogEntryWrite(BlogEntry *entry)
+/**************************************************************************
+*
+* The summary file has a line per entry, in order:
+*
+*       YYYY/MM/DD.N TAB title
+*
+* which is enough to render an overview of the entire blog without opening
+* a file per entry.  It's kept up to date by BlogEntryWrite(), and built
+* from the titles files the first time it's needed.
+*
+***************************************************************************/
+
+static int summary_line(char *line,size_t size,struct btm const *when,char const *title)
 {
-  char   **authors;
-  char   **class;
-  char   **status;
-  char   **titles;
-  char   **adtag;
-  size_t   numa;
-  size_t   numc;
-  size_t   nums;
-  size_t   numt;
-  size_t   numad;
-  size_t   maxnum;
-  char     filename[FILENAME_MAX];
-  FILE    *out;
-  int      rc;
-  int      lock;
+  assert(line != NULL);
+  assert(when != NULL);
   
-  assert(entry != NULL);
-  assert(entry->valid);
+  return snprintf(
+                   line,
+                   size,
+                   "%d/%02d/%02d.%d\t%s\n",
+                   when->year,
+                   when->month,
+                   when->day,
+                   when->part,
+                   title != NULL ? title : ""
+                 );
+}
+
+/**************************************************************************/
+
+static bool summary_rebuild(Blog *blog)
+{
+  BlogCursor   cursor;
+  struct btm   when;
+  struct btm   day;
+  char       **titles = NULL;
+  size_t       numt   = 0;
+  FILE        *out;
   
-  lock = blog_lock(entry->blog->config.lockfile);
-  rc   = date_checkcreate(&entry->when);
-  if (rc != 0)
-    return rc;
-    
-  /*---------------------------------------------------------------------
-  ; The meta-data for the entries are stored in separate files.  When
-  ; updating an entry (or adding an entry), we need to rewrite these
-  ; metafiles.  So, we read them all in, make the adjustments required and
-  ; write them out.
-  ;------------------------------------------------------------------------*/
+  assert(blog != NULL);
   
-  numa   = blog_meta_read(&authors,"authors",&entry->when);
-  numc   = blog_meta_read(&class,  "class",  &entry->when);
-  nums   = blog_meta_read(&status, "status", &entry->when);
-  numt   = blog_meta_read(&titles, "titles", &entry->when);
-  numad  = blog_meta_read(&adtag,  "adtag",  &entry->when);
-  maxnum = max(numa,max(numc,max(nums,numt)));
+  out = stats_fopen(".summary.new","w");
+  if (out == NULL)
+  {
+    syslog(LOG_ERR,".summary.new: %s",strerror(errno));
+    return false;
+  }
   
-  blog_meta_adjust(&authors,numa, maxnum);
-  blog_meta_adjust(&class,  numc, maxnum);
-  blog_meta_adjust(&status, nums, maxnum);
-  blog_meta_adjust(&titles, numt, maxnum);
-  blog_meta_adjust(&adtag,  numad,maxnum);
+  memset(&day,0,sizeof(day));
+  BlogCursorInit(&cursor,blog,&blog->first,&blog->last,false);
   
-  if (entry->when.part == 0)
+  while(BlogCursorNext(&cursor,&when))
   {
-    if (maxnum == 99)
-      return ENOMEM;
+    char line[BUFSIZ];
+    int  len;
+    
+    if (btm_cmp_date(&when,&day) != 0)
+    {
+      if (titles != NULL)
+      {
+        for (size_t i = 0 ; i < numt ; i++)
+          free(titles[i]);
+        free(titles);
+      }
       
-    authors[maxnum]  = strdup(entry->author);
-    class  [maxnum]  = strdup(entry->class);
-    status [maxnum]  = strdup(entry->status);
-    titles [maxnum]  = strdup(entry->title);
-    adtag  [maxnum]  = strdup(entry->adtag);
-    entry->when.part = ++maxnum;
+      numt = blog_meta_read(&titles,"titles",&when);
+      day  = when;
+    }
+    
+    len = summary_line(
+                        line,
+                        sizeof(line),
+                        &when,
+                        (size_t)when.part <= numt ? titles[when.part - 1] : NULL
+                      );
+    fputs(line,out);
+    stats_written(len);
   }
-  else
+  
+  if (titles != NULL)
   {
-    free(authors[entry->when.part]);
-    free(class  [entry->when.part]);
-    free(status [entry->when.part]);
-    free(titles [entry->when.part]);
-    free(adtag  [entry->when.part]);
-    
-    authors[entry->when.part] = strdup(entry->author);
-    class  [entry->when.part] = strdup(entry->class);
-    status [entry->when.part] = strdup(entry->status);
-    titles [entry->when.part] = strdup(entry->title);
-    adtag  [entry->when.part] = strdup(entry->adtag);
+    for (size_t i = 0 ; i < numt ; i++)
+      free(titles[i]);
+    free(titles);
   }
   
-  blog_meta_write("authors",&entry->when,authors,maxnum);
-  blog_meta_write("class"  ,&entry->when,class,  maxnum);
-  blog_meta_write("status" ,&entry->when,status, maxnum);
-  blog_meta_write("titles" ,&entry->when,titles, maxnum);
-  blog_meta_write("adtag"  ,&entry->when,adtag,  maxnum);
+  if ((fclose(out) != 0) || (rename(".summary.new",".summary") != 0))
+  {
+    syslog(LOG_ERR,".summary: %s",strerror(errno));
+    remove(".summary.new");
+    return false;
+  }
   
-  /*-------------------------------
-  ; update the actual entry body
-  ;---------------------------------*/
+  return true;
+}
+
+/**************************************************************************/
+
+static void summary_update(BlogEntry const *entry)
+{
+  char     line[BUFSIZ];
+  int      len;
+  FILE    *in;
+  FILE    *out;
+  char    *text = NULL;
+  size_t   size = 0;
+  ssize_t  bytes;
+  bool     done = false;
   
-  date_to_part(filename,&entry->when,entry->when.part);
-  out = fopen(filename,"w");
-  fputs(entry->body,out);
-  fclose(out);
+  assert(entry != NULL);
   
-  /*-----------------
-  ; clean up
-  ;------------------*/
+  /*----------------------------------------------------------------------
+  ; If there's no summary yet, it will be built (with this entry) when it's
+  ; next needed.
+  ;-----------------------------------------------------------------------*/
   
-  for(size_t i = 0 ; i < maxnum ; i++)
+  if (stats_access(".summary",F_OK) != 0)
+    return;
+    
+  len = summary_line(line,sizeof(line),&entry->when,entry->title);
+  
+  /*----------------------------------------------------------------------
+  ; The common case---a new latest entry just goes on the end.
+  ;-----------------------------------------------------------------------*/
+  
+  if (btm_cmp(&entry->when,&entry->blog->last) > 0)
   {
-    free(authors[i]);
-    free(class[i]);
-    free(status[i]);
-    free(titles[i]);
-    free(adtag[i]);
+    out = stats_fopen(".summary","a");
+    if (out == NULL)
+    {
+      syslog(LOG_ERR,".summary: %s",strerror(errno));
+      return;
+    }
+    fputs(line,out);
+    stats_written(len);
+    fclose(out);
+    return;
   }
   
-  free(authors);
-  free(class);
-  free(status);
-  free(titles);
-  free(adtag);
+  /*----------------------------------------------------------------------
+  ; Otherwise, it's an edit or a backdated entry, so copy the summary over,
+  ; replacing (or inserting) the line for this entry.
+  ;-----------------------------------------------------------------------*/
   
-  /*------------------------------------------------------------------------
-  ; Oh, and if this is the latest entry to be added, update the .last file
-  ; to reflect that.
-  ;------------------------------------------------------------------------*/
+  in  = stats_fopen(".summary","r");
+  out = stats_fopen(".summary.new","w");
   
-  if (btm_cmp(&entry->when,&entry->blog->last) > 0)
+  if ((in == NULL) || (out == NULL))
+  {
+    syslog(LOG_ERR,".summary: %s",strerror(errno));
+    if (in)  fclose(in);
+    if (out) fclose(out);
+    return;
+  }
+  
+  while((bytes = getline(&text,&size,in)) != -1)
   {
-    Blog *blog = (Blog *)entry->blog; /* XXX how to handle */
-    blog->last = entry->when;
-    blog->now  = entry->when;
+    struct btm when;
     
-    out = fopen(".last","w");
+    stats_read(bytes);
     
-    if (out)
+    if (
+            !done
+         && (sscanf(text,"%d/%d/%d.%d",&when.year,&when.month,&when.day,&when.part) == 4)
+         && (btm_cmp(&when,&entry->when) >= 0)
+       )
     {
-      fprintf(
-                out,
-                "%d/%02d/%02d.%d\n",
-                entry->when.year,
-                entry->when.month,
-                entry->when.day,
-                entry->when.part
-        );
-      fclose(out);
+      fputs(line,out);
+      stats_written(len);
+      done = true;
+      
+      if (btm_cmp(&when,&entry->when) == 0)
+        continue;
     }
+    
+    fputs(text,out);
+    stats_written(bytes);
   }
   
-  entry->blog->lastmod = entry->timestamp;
-  blog_unlock(entry->blog->config.lockfile,lock);
-  return 0;
+  if (!done)
+  {
+    fputs(line,out);
+    stats_written(len);
+  }
+  
+  free(text);
+  fclose(in);
+  
+  if ((fclose(out) != 0) || (rename(".summary.new",".summary") != 0))
+  {
+    syslog(LOG_ERR,".summary: %s",strerror(errno));
+    remove(".summary.new");
+  }
 }
 
-/***********************************************************************/
+/**************************************************************************/
 
-size_t BlogLastEntry(Blog *blog,struct btm const *when)
+/**************************************************************************
+*
+* The "on this day" index is a directory with a file per month and day,
+* .thisday/MM-DD, each with a line per entry posted on that day, in order:
+*
+*       YYYY.N
+*
+* so finding the entries for a given day over all the years is one small
+* read.  Like the summary, it's kept up to date by BlogEntryWrite(), and
+* built the first time it's needed.
+*
+***************************************************************************/
+
+static bool index_dir_new(char const *dirname)
 {
-  (void)blog;
+  DIR *dir;
+  
+  assert(dirname != NULL);
+  
+  /*----------------------------------------------------------------------
+  ; An index is built in a new directory, which is then renamed into place.
+  ; Clean out anything left behind by an earlier attempt that failed.
+  ;-----------------------------------------------------------------------*/
+  
+  dir = opendir(dirname);
+  if (dir != NULL)
+  {
+    struct dirent *ent;
+    char           name[FILENAME_MAX];
+    
+    while((ent = readdir(dir)) != NULL)
+    {
+      if (ent->d_name[0] == '.')
+        continue;
+      snprintf(name,sizeof(name),"%s/%s",dirname,ent->d_name);
+      remove(name);
+    }
+    closedir(dir);
+  }
+  else if (mkdir(dirname,0755) != 0)
+  {
+    syslog(LOG_ERR,"%s: %s",dirname,strerror(errno));
+    return false;
+  }
+  
+  return true;
+}
+
+/**************************************************************************/
+
+static bool index_dir_rename(char const *newname,char const *dirname)
+{
+  assert(newname != NULL);
+  assert(dirname != NULL);
+  
+  if (rename(newname,dirname) == 0)
+    return true;
+  if ((errno != ENOTEMPTY) && (errno != EEXIST))
+    return false;
+    
+  /*----------------------------------------------------------------------
+  ; An index rebuilt while there's still one in place (as after a batch of
+  ; entries) is swapped with it, so there's always one to read.  Failing
+  ; that, the old one goes first.
+  ;-----------------------------------------------------------------------*/
+  
+  if (renameat2(AT_FDCWD,newname,AT_FDCWD,dirname,RENAME_EXCHANGE) == 0)
+  {
+    index_dir_new(newname);
+    rmdir(newname);
+    return true;
+  }
+  
+  index_dir_new(dirname);
+  rmdir(dirname);
+  return rename(newname,dirname) == 0;
+}
+
+/**************************************************************************/
+
+static void thisday_name(char *name,size_t size,char const *dir,struct btm const *when)
+{
+  assert(name != NULL);
+  assert(dir  != NULL);
   assert(when != NULL);
   
-  char name[FILENAME_MAX];
+  snprintf(name,size,"%s/%02d-%02d",dir,when->month,when->day);
+}
+
+/**************************************************************************/
+
+static int thisday_cmp(void const *left,void const *right)
+{
+  struct btm const *l = left;
+  struct btm const *r = right;
   
-  for (int i = 1 ; i < ENTRY_MAX ; i++)
+  if (l->month != r->month) return l->month - r->month;
+  if (l->day   != r->day)   return l->day   - r->day;
+  if (l->year  != r->year)  return l->year  - r->year;
+  return l->part - r->part;
+}
+
+/**************************************************************************/
+
+static size_t thisday_read(char const *name,struct btm const *day,struct btm **plist)
+{
+  struct btm *list = NULL;
+  size_t      num  = 0;
+  size_t      room = 0;
+  char        line[64];
+  FILE       *in;
+  
+  assert(name  != NULL);
+  assert(day   != NULL);
+  assert(plist != NULL);
+  
+  in = stats_fopen(name,"r");
+  if (in != NULL)
   {
-    date_to_part(name,when,i);
-    if (access(name,R_OK) == -1)
-      return (size_t)i-1;
+    while(fgets(line,sizeof(line),in) != NULL)
+    {
+      struct btm when = *day;
+      
+      stats_read(strlen(line));
+      if (sscanf(line,"%d.%d",&when.year,&when.part) != 2)
+        continue;
+        
+      if (num == room)
+      {
+        struct btm *n;
+        
+        room = room == 0 ? 16 : room * 2;
+        n    = realloc(list,room * sizeof(struct btm));
+        if (n == NULL)
+          break;
+        list = n;
+      }
+      
+      list[num++] = when;
+    }
+    
+    fclose(in);
   }
-  return 0;
+  
+  *plist = list;
+  return num;
+}
+
+/**************************************************************************/
+
+static bool thisday_write(char const *name,struct btm const *list,size_t num)
+{
+  FILE *out;
+  
+  assert(name != NULL);
+  assert((list != NULL) || (num == 0));
+  
+  out = stats_fopen(name,"w");
+  if (out == NULL)
+  {
+    syslog(LOG_ERR,"%s: %s",name,strerror(errno));
+    return false;
+  }
+  
+  for (size_t i = 0 ; i < num ; i++)
+    stats_written(fprintf(out,"%d.%d\n",list[i].year,list[i].part));
+    
+  if (fclose(out) != 0)
+  {
+    syslog(LOG_ERR,"%s: %s",name,strerror(errno));
+    return false;
+  }
+  
+  return true;
+}
+
+/**************************************************************************/
+
+static bool thisday_rebuild(Blog *blog)
+{
+  BlogCursor  cursor;
+  struct btm  when;
+  struct btm *list = NULL;
+  size_t      num  = 0;
+  size_t      room = 0;
+  bool        okay = true;
+  
+  assert(blog != NULL);
+  
+  if (!index_dir_new(".thisday.new"))
+    return false;
+    
+  /*----------------------------------------------------------------------
+  ; Collect all the entries, then sort them by month and day so each file
+  ; is written out in one go.
+  ;-----------------------------------------------------------------------*/
+  
+  BlogCursorInit(&cursor,blog,&blog->first,&blog->last,false);
+  
+  while(BlogCursorNext(&cursor,&when))
+  {
+    if (num == room)
+    {
+      struct btm *n;
+      
+      room = room == 0 ? 1024 : room * 2;
+      n    = realloc(list,room * sizeof(struct btm));
+      if (n == NULL)
+      {
+        free(list);
+        return false;
+      }
+      list = n;
+    }
+    
+    list[num++] = when;
+  }
+  
+  if (num > 0)
+    qsort(list,num,sizeof(struct btm),thisday_cmp);
+    
+  for (size_t i = 0 ; okay && (i < num) ; )
+  {
+    char   name[FILENAME_MAX];
+    size_t j;
+    
+    for (j = i + 1 ; j < num ; j++)
+      if ((list[j].month != list[i].month) || (list[j].day != list[i].day))
+        break;
+        
+    thisday_name(name,sizeof(name),".thisday.new",&list[i]);
+    okay = thisday_write(name,&list[i],j - i);
+    i    = j;
+  }
+  
+  free(list);
+  
+  if (okay && !index_dir_rename(".thisday.new",".thisday"))
+  {
+    syslog(LOG_ERR,".thisday: %s",strerror(errno));
+    okay = false;
+  }
+  
+  return okay;
+}
+
+/**************************************************************************/
+
+static void thisday_update(BlogEntry const *entry)
+{
+  char        name[FILENAME_MAX];
+  char        tmp [FILENAME_MAX + sizeof(".new")];
+  struct btm *list;
+  size_t      num;
+  size_t      i;
+  
+  assert(entry != NULL);
+  
+  if (stats_access(".thisday",F_OK) != 0)
+    return;
+    
+  thisday_name(name,sizeof(name),".thisday",&entry->when);
+  num = thisday_read(name,&entry->when,&list);
+  
+  /*----------------------------------------------------------------------
+  ; An edit to an existing entry doesn't change the index.  Otherwise, the
+  ; entry is inserted in order (almost always at the end).
+  ;-----------------------------------------------------------------------*/
+  
+  for (i = 0 ; i < num ; i++)
+    if (btm_cmp(&list[i],&entry->when) >= 0)
+      break;
+      
+  if ((i < num) && (btm_cmp(&list[i],&entry->when) == 0))
+  {
+    free(list);
+    return;
+  }
+  
+  {
+    struct btm *n = realloc(list,(num + 1) * sizeof(struct btm));
+    
+    if (n == NULL)
+    {
+      free(list);
+      return;
+    }
+    
+    list = n;
+    memmove(&list[i + 1],&list[i],(num - i) * sizeof(struct btm));
+    list[i] = entry->when;
+    num++;
+  }
+  
+  snprintf(tmp,sizeof(tmp),"%s.new",name);
+  if (thisday_write(tmp,list,num) && (rename(tmp,name) != 0))
+  {
+    syslog(LOG_ERR,"%s: %s",name,strerror(errno));
+    remove(tmp);
+  }
+  
+  free(list);
+}
+
+/**************************************************************************
+*
+* The class index is another directory, .class, with a file per class tag,
+* each with a line per entry with that tag, in order:
+*
+*       YYYY/MM/DD.N
+*
+* The file name is the tag folded to lower case, with anything other than
+* a letter, digit, '-' or '_' written as %XX.  It too is kept up to date by
+* BlogEntryWrite(), and built the first time it's needed.
+*
+* A long tag (or not even that long, if it's not ASCII) could escape to
+* more than a file name can hold, so past CLASS_NAME_MAX the name is cut
+* short and ended with a '~' and the hash of the whole (folded) tag.
+*
+* Files named after a tag outside the blog (see BlogClassName()) use '_'
+* in place of the '%', as a web server would decode the %XX, so there a
+* '_' is escaped as well.
+*
+***************************************************************************/
+
+#define CLASS_NAME_MAX  (NAME_MAX - 4)  /* room for a ".new" suffix */
+#define CLASS_HASH_LEN  17              /* '~' and 16 hex digits    */
+
+static size_t class_escape(char *name,size_t size,String tag,char esc)
+{
+  size_t   len  = 0;
+  size_t   need = 0;
+  size_t   max;
+  uint64_t hash = HASH_INIT;
+  
+  assert(name != NULL);
+  assert(size >  CLASS_HASH_LEN);
+  
+  for (size_t i = 0 ; i < tag.s ; i++)
+  {
+    unsigned char c = tag.d[i];
+    
+    need += isalnum(c) || (c == '-') || ((c == '_') && (esc != '_')) ? 1 : 3;
+    c     = tolower(c);
+    hash  = hash_mem(hash,&c,1);
+  }
+  
+  max = CLASS_NAME_MAX < size ? CLASS_NAME_MAX : size - 1;
+  if (need > max)
+    max -= CLASS_HASH_LEN;
+    
+  for (size_t i = 0 ; i < tag.s ; i++)
+  {
+    unsigned char c = tag.d[i];
+    
+    if (isalnum(c) || (c == '-') || ((c == '_') && (esc != '_')))
+    {
+      if (len + 1 > max)
+        break;
+      name[len++] = tolower(c);
+    }
+    else
+    {
+      if (len + 3 > max)
+        break;
+      len += snprintf(&name[len],size - len,"%c%02X",esc,c);
+    }
+  }
+  
+  if (need > len)
+    len += snprintf(&name[len],size - len,"~%016llX",(unsigned long long)hash);
+    
+  name[len] = '\0';
+  return len;
+}
+
+/**************************************************************************/
+
+static void class_name(char *name,size_t size,char const *dir,String tag)
+{
+  size_t len;
+  
+  assert(name != NULL);
+  assert(dir  != NULL);
+  assert(size >  0);
+  
+  len = snprintf(name,size,"%s/",dir);
+  assert(len + CLASS_HASH_LEN < size);
+  class_escape(&name[len],size - len,tag,'%');
+}
+
+/**************************************************************************/
+
+static size_t class_read(char const *name,struct btm **plist)
+{
+  struct btm *list = NULL;
+  size_t      num  = 0;
+  size_t      room = 0;
+  char        line[64];
+  FILE       *in;
+  
+  assert(name  != NULL);
+  assert(plist != NULL);
+  
+  in = stats_fopen(name,"r");
+  if (in != NULL)
+  {
+    while(fgets(line,sizeof(line),in) != NULL)
+    {
+      struct btm when;
+      
+      stats_read(strlen(line));
+      if (sscanf(line,"%d/%d/%d.%d",&when.year,&when.month,&when.day,&when.part) != 4)
+        continue;
+        
+      if (num == room)
+      {
+        struct btm *n;
+        
+        room = room == 0 ? 64 : room * 2;
+        n    = realloc(list,room * sizeof(struct btm));
+        if (n == NULL)
+          break;
+        list = n;
+      }
+      
+      list[num++] = when;
+    }
+    
+    fclose(in);
+  }
+  
+  *plist = list;
+  return num;
+}
+
+/**************************************************************************/
+
+static bool class_write(char const *name,struct btm const *list,size_t num)
+{
+  FILE *out;
+  
+  assert(name != NULL);
+  assert((list != NULL) || (num == 0));
+  
+  out = stats_fopen(name,"w");
+  if (out == NULL)
+  {
+    syslog(LOG_ERR,"%s: %s",name,strerror(errno));
+    return false;
+  }
+  
+  for (size_t i = 0 ; i < num ; i++)
+    stats_written(fprintf(out,"%d/%02d/%02d.%d\n",list[i].year,list[i].month,list[i].day,list[i].part));
+    
+  if (fclose(out) != 0)
+  {
+    syslog(LOG_ERR,"%s: %s",name,strerror(errno));
+    return false;
+  }
+  
+  return true;
+}
+
+/**************************************************************************/
+
+struct classpair
+{
+  char       *name;
+  struct btm  when;
+};
+
+static int classpair_cmp(void const *left,void const *right)
+{
+  struct classpair const *l  = left;
+  struct classpair const *r  = right;
+  int                     rc = strcmp(l->name,r->name);
+  
+  return rc != 0 ? rc : btm_cmp(&l->when,&r->when);
+}
+
+/**************************************************************************/
+
+static bool class_rebuild(Blog *blog)
+{
+  BlogCursor         cursor;
+  struct btm         when;
+  struct btm         day;
+  struct classpair  *pairs  = NULL;
+  size_t             num    = 0;
+  size_t             room   = 0;
+  char             **class  = NULL;
+  size_t             numc   = 0;
+  bool               okay   = true;
+  struct btm        *list   = NULL;
+  
+  assert(blog != NULL);
+  
+  if (!index_dir_new(".class.new"))
+    return false;
+    
+  /*----------------------------------------------------------------------
+  ; Collect a (tag,entry) pair for every tag of every entry, reading the
+  ; class file once per day, then sort them by tag so each file is written
+  ; out in one go.
+  ;-----------------------------------------------------------------------*/
+  
+  memset(&day,0,sizeof(day));
+  BlogCursorInit(&cursor,blog,&blog->first,&blog->last,false);
+  
+  while(okay && BlogCursorNext(&cursor,&when))
+  {
+    String *tags;
+    size_t  numtags;
+    
+    if (btm_cmp_date(&when,&day) != 0)
+    {
+      if (class != NULL)
+      {
+        for (size_t i = 0 ; i < numc ; i++)
+          free(class[i]);
+        free(class);
+      }
+      
+      numc = blog_meta_read(&class,"class",&when);
+      day  = when;
+    }
+    
+    if ((size_t)when.part > numc)
+      continue;
+      
+    tags = tag_split(&numtags,class[when.part - 1]);
+    
+    for (size_t i = 0 ; i < numtags ; i++)
+    {
+      char name[FILENAME_MAX];
+      
+      if (num == room)
+      {
+        struct classpair *n;
+        
+        room = room == 0 ? 1024 : room * 2;
+        n    = realloc(pairs,room * sizeof(struct classpair));
+        if (n == NULL)
+        {
+          okay = false;
+          break;
+        }
+        pairs = n;
+      }
+      
+      class_name(name,sizeof(name),".class.new",tags[i]);
+      pairs[num].name = strdup(name);
+      pairs[num].when = when;
+      if (pairs[num].name == NULL)
+      {
+        okay = false;
+        break;
+      }
+      num++;
+    }
+    
+    free(tags);
+  }
+  
+  if (class != NULL)
+  {
+    for (size_t i = 0 ; i < numc ; i++)
+      free(class[i]);
+    free(class);
+  }
+  
+  if (okay && (num > 0))
+  {
+    qsort(pairs,num,sizeof(struct classpair),classpair_cmp);
+    list = malloc(num * sizeof(struct btm));
+    okay = list != NULL;
+  }
+  
+  for (size_t i = 0 ; okay && (i < num) ; )
+  {
+    size_t j;
+    size_t n = 0;
+    
+    for (j = i ; (j < num) && (strcmp(pairs[j].name,pairs[i].name) == 0) ; j++)
+      if ((n == 0) || (btm_cmp(&list[n - 1],&pairs[j].when) != 0))
+        list[n++] = pairs[j].when;
+        
+    /*--------------------------------------------------------------------
+    ; A tag that can't be written (class_write() logs why) is left out,
+    ; rather than throwing away the index for every other tag.
+    ;---------------------------------------------------------------------*/
+    
+    class_write(pairs[i].name,list,n);
+    i = j;
+  }
+  
+  for (size_t i = 0 ; i < num ; i++)
+    free(pairs[i].name);
+  free(pairs);
+  free(list);
+  
+  if (okay && !index_dir_rename(".class.new",".class"))
+  {
+    syslog(LOG_ERR,".class: %s",strerror(errno));
+    okay = false;
+  }
+  
+  return okay;
+}
+
+/**************************************************************************/
+
+static void class_change(String tag,struct btm const *when,bool add)
+{
+  char        name[FILENAME_MAX];
+  char        tmp [FILENAME_MAX + sizeof(".new")];
+  struct btm *list;
+  size_t      num;
+  size_t      i;
+  
+  assert(when != NULL);
+  
+  class_name(name,sizeof(name),".class",tag);
+  num = class_read(name,&list);
+  
+  for (i = 0 ; i < num ; i++)
+    if (btm_cmp(&list[i],when) >= 0)
+      break;
+      
+  if (add)
+  {
+    struct btm *n;
+    
+    if ((i < num) && (btm_cmp(&list[i],when) == 0))
+    {
+      free(list);
+      return;
+    }
+    
+    n = realloc(list,(num + 1) * sizeof(struct btm));
+    if (n == NULL)
+    {
+      free(list);
+      return;
+    }
+    
+    list = n;
+    memmove(&list[i + 1],&list[i],(num - i) * sizeof(struct btm));
+    list[i] = *when;
+    num++;
+  }
+  else
+  {
+    if ((i == num) || (btm_cmp(&list[i],when) != 0))
+    {
+      free(list);
+      return;
+    }
+    
+    memmove(&list[i],&list[i + 1],(num - i - 1) * sizeof(struct btm));
+    num--;
+  }
+  
+  if (num == 0)
+    remove(name);
+  else
+  {
+    snprintf(tmp,sizeof(tmp),"%s.new",name);
+    if (class_write(tmp,list,num) && (rename(tmp,name) != 0))
+    {
+      syslog(LOG_ERR,"%s: %s",name,strerror(errno));
+      remove(tmp);
+    }
+  }
+  
+  free(list);
+}
+
+/**************************************************************************/
+
+static bool class_has(String const *tags,size_t num,String tag)
+{
+  assert((tags != NULL) || (num == 0));
+  
+  for (size_t i = 0 ; i < num ; i++)
+  {
+    if (tags[i].s == tag.s)
+    {
+      size_t j;
+      
+      for (j = 0 ; j < tag.s ; j++)
+        if (tolower((unsigned char)tags[i].d[j]) != tolower((unsigned char)tag.d[j]))
+          break;
+      if (j == tag.s)
+        return true;
+    }
+  }
+  
+  return false;
+}
+
+/**************************************************************************/
+
+static void class_update(BlogEntry const *entry,char const *oldclass)
+{
+  String *old    = NULL;
+  String *new    = NULL;
+  size_t  numold = 0;
+  size_t  numnew = 0;
+  
+  assert(entry != NULL);
+  
+  if (stats_access(".class",F_OK) != 0)
+    return;
+    
+  /*----------------------------------------------------------------------
+  ; Take the entry out of the tags it no longer has (if it's an edit), and
+  ; add it to the ones it now has.
+  ;-----------------------------------------------------------------------*/
+  
+  if (oldclass != NULL)
+    old = tag_split(&numold,oldclass);
+  if (entry->class != NULL)
+    new = tag_split(&numnew,entry->class);
+    
+  for (size_t i = 0 ; i < numold ; i++)
+    if (!class_has(new,numnew,old[i]))
+      class_change(old[i],&entry->when,false);
+      
+  for (size_t i = 0 ; i < numnew ; i++)
+    if (!class_has(old,numold,new[i]))
+      class_change(new[i],&entry->when,true);
+      
+  free(old);
+  free(new);
+}
+
+/**************************************************************************/
+
+static void date_write(char const *file,struct btm const *when)
+{
+  FILE *out;
+  
+  assert(file != NULL);
+  assert(when != NULL);
+  
+  out = stats_fopen(file,"w");
+  
+  if (out)
+  {
+    fprintf(
+              out,
+              "%d/%02d/%02d.%d\n",
+              when->year,
+              when->month,
+              when->day,
+              when->part
+      );
+    fclose(out);
+  }
+}
+
+/***********************************************************************/
+
+static int entry_write_day(BlogEntry *entries[],size_t num,char **poldclass)
+{
+  char   **authors;
+  char   **class;
+  char   **status;
+  char   **titles;
+  char   **adtag;
+  size_t   numa;
+  size_t   numc;
+  size_t   nums;
+  size_t   numt;
+  size_t   numad;
+  size_t   maxnum;
+  size_t   add;
+  char     filename[FILENAME_MAX];
+  FILE    *out;
+  int      rc;
+  
+  assert(entries != NULL);
+  assert(num     >  0);
+  
+  rc = date_checkcreate(&entries[0]->when);
+  if (rc != 0)
+    return rc;
+    
+  /*---------------------------------------------------------------------
+  ; The meta-data for the entries are stored in separate files.  When
+  ; updating an entry (or adding an entry), we need to rewrite these
+  ; metafiles.  So, we read them all in, make the adjustments required and
+  ; write them out, once for all the entries of the day.
+  ;------------------------------------------------------------------------*/
+  
+  numa   = blog_meta_read(&authors,"authors",&entries[0]->when);
+  numc   = blog_meta_read(&class,  "class",  &entries[0]->when);
+  nums   = blog_meta_read(&status, "status", &entries[0]->when);
+  numt   = blog_meta_read(&titles, "titles", &entries[0]->when);
+  numad  = blog_meta_read(&adtag,  "adtag",  &entries[0]->when);
+  maxnum = max(numa,max(numc,max(nums,numt)));
+  
+  blog_meta_adjust(&authors,numa, maxnum);
+  blog_meta_adjust(&class,  numc, maxnum);
+  blog_meta_adjust(&status, nums, maxnum);
+  blog_meta_adjust(&titles, numt, maxnum);
+  blog_meta_adjust(&adtag,  numad,maxnum);
+  
+  add = 0;
+  for (size_t i = 0 ; i < num ; i++)
+    if (entries[i]->when.part == 0)
+      add++;
+      
+  if (maxnum + add > ENTRY_MAX)
+    rc = ENOMEM;
+  else
+  {
+    for (size_t i = 0 ; i < num ; i++)
+    {
+      BlogEntry *entry = entries[i];
+      
+      assert(entry->valid);
+      assert(btm_cmp_date(&entry->when,&entries[0]->when) == 0);
+      
+      if (entry->when.part == 0)
+      {
+        authors[maxnum]  = strdup(entry->author);
+        class  [maxnum]  = strdup(entry->class);
+        status [maxnum]  = strdup(entry->status);
+        titles [maxnum]  = strdup(entry->title);
+        adtag  [maxnum]  = strdup(entry->adtag);
+        entry->when.part = ++maxnum;
+      }
+      else
+      {
+        size_t idx = entry->when.part - 1;
+        
+        assert(poldclass != NULL);
+        assert(num       == 1);
+        
+        *poldclass = class[idx];
+        
+        free(authors[idx]);
+        free(status [idx]);
+        free(titles [idx]);
+        free(adtag  [idx]);
+        
+        authors[idx] = strdup(entry->author);
+        class  [idx] = strdup(entry->class);
+        status [idx] = strdup(entry->status);
+        titles [idx] = strdup(entry->title);
+        adtag  [idx] = strdup(entry->adtag);
+      }
+    }
+    
+    blog_meta_write("authors",&entries[0]->when,authors,maxnum);
+    blog_meta_write("class"  ,&entries[0]->when,class,  maxnum);
+    blog_meta_write("status" ,&entries[0]->when,status, maxnum);
+    blog_meta_write("titles" ,&entries[0]->when,titles, maxnum);
+    blog_meta_write("adtag"  ,&entries[0]->when,adtag,  maxnum);
+    
+    /*-------------------------------
+    ; update the actual entry bodies
+    ;---------------------------------*/
+    
+    for (size_t i = 0 ; i < num ; i++)
+    {
+      date_to_part(filename,&entries[i]->when,entries[i]->when.part);
+      out = stats_fopen(filename,"w");
+      fputs(entries[i]->body,out);
+      stats_written(ftell(out));
+      fclose(out);
+    }
+  }
+  
+  /*-----------------
+  ; clean up
+  ;------------------*/
+  
+  for(size_t i = 0 ; i < maxnum ; i++)
+  {
+    free(authors[i]);
+    free(class[i]);
+    free(status[i]);
+    free(titles[i]);
+    free(adtag[i]);
+  }
+  
+  free(authors);
+  free(class);
+  free(status);
+  free(titles);
+  free(adtag);
+  return rc;
+}
+
+/***********************************************************************/
+
+int BlogEntryWrite(BlogEntry *entry,char **poldclass)
+{
+  char *oldclass = NULL;
+  int   rc;
+  int   lock;
+  
+  assert(entry != NULL);
+  assert(entry->valid);
+  
+  /*----------------------------------------------------------------------
+  ; If given poldclass, an edit hands back the tags the entry had before
+  ; (anything else, NULL), for the caller to free.
+  ;-----------------------------------------------------------------------*/
+  
+  
+  lock = blog_lock(entry->blog->config.lockfile);
+  rc   = entry_write_day(&entry,1,&oldclass);
+  
+  if (rc == 0)
+  {
+    summary_update(entry);
+    thisday_update(entry);
+    search_update(entry);
+    class_update(entry,oldclass);
+    
+    /*----------------------------------------------------------------------
+    ; Oh, and if this is the latest entry to be added, update the .last file
+    ; to reflect that.
+    ;-----------------------------------------------------------------------*/
+    
+    if (btm_cmp(&entry->when,&entry->blog->last) > 0)
+    {
+      Blog *blog = (Blog *)entry->blog; /* XXX how to handle */
+      blog->last = entry->when;
+      blog->now  = entry->when;
+      date_write(".last",&entry->when);
+    }
+    
+    entry->blog->lastmod = entry->timestamp;
+  }
+  
+  if ((rc == 0) && (poldclass != NULL))
+    *poldclass = oldclass;
+  else
+    free(oldclass);
+  blog_unlock(entry->blog->config.lockfile,lock);
+  return rc;
+}
+
+/***********************************************************************/
+
+struct batchent
+{
+  BlogEntry *entry;
+  size_t     order;
+};
+
+/***********************************************************************/
+
+static int batchent_cmp(void const *left,void const *right)
+{
+  struct batchent const *l = left;
+  struct batchent const *r = right;
+  int                    rc;
+  
+  rc = btm_cmp_date(&l->entry->when,&r->entry->when);
+  if (rc == 0)
+    rc = l->order < r->order ? -1 : l->order > r->order ? 1 : 0;
+  return rc;
+}
+
+/************************************************************************
+*
+* Write a batch of new entries (say, from an import) under one lock.  The
+* entries are grouped by day (keeping their order within a day), and the
+* meta data for a day is rewritten once for all its entries.  Instead of
+* updating the indexes for each entry, any index that exists is rebuilt
+* once at the end.  Should a day fail to be written, the rest are still
+* written, and the first error is returned.
+*
+*************************************************************************/
+
+int BlogEntryWriteBatch(Blog *blog,BlogEntry *entries[],size_t num)
+{
+  struct batchent *batch;
+  BlogEntry      **day;
+  int              rc = 0;
+  int              lock;
+  bool             search;
+  
+  assert(blog    != NULL);
+  assert(entries != NULL);
+  
+  if (num == 0)
+    return 0;
+    
+  batch = malloc(num * sizeof(struct batchent));
+  day   = malloc(num * sizeof(BlogEntry *));
+  if ((batch == NULL) || (day == NULL))
+  {
+    free(day);
+    free(batch);
+    return ENOMEM;
+  }
+  
+  for (size_t i = 0 ; i < num ; i++)
+  {
+    batch[i].entry = entries[i];
+    batch[i].order = i;
+  }
+  
+  qsort(batch,num,sizeof(struct batchent),batchent_cmp);
+  lock = blog_lock(blog->config.lockfile);
+  
+  for (size_t i = 0 ; i < num ; )
+  {
+    size_t n = 0;
+    int    err;
+    
+    do
+    {
+      assert(batch[i].entry->when.part == 0);
+      day[n++] = batch[i++].entry;
+    } while((i < num) && (btm_cmp_date(&batch[i].entry->when,&day[0]->when) == 0));
+    
+    err = entry_write_day(day,n,NULL);
+    if (err != 0)
+    {
+      syslog(
+              LOG_ERR,
+              "%d/%02d/%02d: %s",
+              day[0]->when.year,
+              day[0]->when.month,
+              day[0]->when.day,
+              strerror(err)
+            );
+      if (rc == 0)
+        rc = err;
+      continue;
+    }
+    
+    if (btm_cmp(&day[n-1]->when,&blog->last) > 0)
+    {
+      blog->last = day[n-1]->when;
+      blog->now  = day[n-1]->when;
+      date_write(".last",&blog->last);
+    }
+    
+    if (btm_cmp(&day[0]->when,&blog->first) < 0)
+    {
+      blog->first = day[0]->when;
+      date_write(".first",&blog->first);
+    }
+    
+    for (size_t j = 0 ; j < n ; j++)
+      if (day[j]->timestamp > blog->lastmod)
+        blog->lastmod = day[j]->timestamp;
+  }
+  
+  free(day);
+  free(batch);
+  
+  if (stats_access(".summary",F_OK) == 0)
+    summary_rebuild(blog);
+  if (stats_access(".thisday",F_OK) == 0)
+    thisday_rebuild(blog);
+  if (stats_access(".class",F_OK) == 0)
+    class_rebuild(blog);
+  search = search_exists();
+  
+  blog_unlock(blog->config.lockfile,lock);
+  
+  /*----------------------------------------------------------------------
+  ; The search index takes the lock itself to be rebuilt.
+  ;-----------------------------------------------------------------------*/
+  
+  if (search)
+    search_build(blog);
+  return rc;
+}
+
+/***********************************************************************/
+
+size_t BlogLastEntry(Blog *blog,struct btm const *when)
+{
+  (void)blog;
+  assert(when != NULL);
+  
+  char name[FILENAME_MAX];
+  
+  for (int i = 1 ; i < ENTRY_MAX ; i++)
+  {
+    date_to_part(name,when,i);
+    if (stats_access(name,R_OK) == -1)
+      return (size_t)i-1;
+  }
+  return 0;
+}
+
+/***********************************************************************/
+
+bool BlogEntryExists(Blog *blog,struct btm const *which)
+{
+  char pname[FILENAME_MAX];
+  
+  (void)blog;
+  assert(which       != NULL);
+  assert(which->part >  0);
+  
+  date_to_part(pname,which,which->part);
+  return stats_access(pname,R_OK) == 0;
+}
+
+/***********************************************************************/
+
+static int last_part(Blog *blog,struct btm const *day)
+{
+  struct btm which = *day;
+  
+  assert(day != NULL);
+  
+  for (which.part = 1 ; which.part <= ENTRY_MAX ; which.part++)
+    if (!BlogEntryExists(blog,&which))
+      break;
+      
+  return which.part - 1;
+}
+
+/***********************************************************************/
+
+void BlogCursorInit(
+        BlogCursor       *cursor,
+        Blog             *blog,
+        struct btm const *restrict start,
+        struct btm const *restrict end,
+        bool              reverse
+)
+{
+  assert(cursor != NULL);
+  assert(blog   != NULL);
+  assert(start  != NULL);
+  assert(end    != NULL);
+  
+  /*-----------------------------------------------------------------------
+  ; A cursor walks the entries between two points (inclusive) using nothing
+  ; more than access(), so it can be used to find out what's on a page
+  ; before reading any of it in.  There are no entries before the first
+  ; entry or after the last one, so clamp the range to save some probing.
+  ;------------------------------------------------------------------------*/
+  
+  cursor->blog    = blog;
+  cursor->start   = *start;
+  cursor->end     = *end;
+  cursor->reverse = reverse;
+  
+  if (btm_cmp(&cursor->start,&blog->first) < 0)
+    cursor->start = blog->first;
+  if (btm_cmp(&cursor->end,&blog->last) > 0)
+    cursor->end = blog->last;
+    
+  if (!reverse)
+    cursor->current = cursor->start;
+  else if (btm_cmp(&cursor->start,&cursor->end) > 0)
+  {
+    cursor->current      = cursor->start;
+    cursor->current.part = 0;
+  }
+  else
+  {
+    int last = last_part(blog,&cursor->end);
+    cursor->current = cursor->end;
+    if (last < cursor->current.part)
+      cursor->current.part = last;
+  }
+}
+
+/***********************************************************************/
+
+bool BlogCursorNext(BlogCursor *cursor,struct btm *which)
+{
+  assert(cursor != NULL);
+  assert(which  != NULL);
+  
+  if (!cursor->reverse)
+  {
+    while(btm_cmp(&cursor->current,&cursor->end) <= 0)
+    {
+      if (BlogEntryExists(cursor->blog,&cursor->current))
+      {
+        *which = cursor->current;
+        cursor->current.part++;
+        return true;
+      }
+      
+      cursor->current.part = 1;
+      btm_inc_day(&cursor->current);
+    }
+  }
+  else
+  {
+    while(btm_cmp_date(&cursor->current,&cursor->start) >= 0)
+    {
+      if (cursor->current.part > 0)
+      {
+        if (btm_cmp(&cursor->current,&cursor->start) < 0)
+          break;
+        *which = cursor->current;
+        cursor->current.part--;
+        return true;
+      }
+      
+      btm_dec_day(&cursor->current);
+      if (btm_cmp_date(&cursor->current,&cursor->start) < 0)
+        break;
+      cursor->current.part = last_part(cursor->blog,&cursor->current);
+    }
+  }
+  
+  return false;
+}
+
+/***********************************************************************/
+
+BlogEntry *BlogCursorRead(BlogCursor *cursor)
+{
+  struct btm which;
+  
+  assert(cursor != NULL);
+  
+  /*-----------------------------------------------------------------------
+  ; An entry can vanish between the access() and the read, so just move on
+  ; to the next one if that happens.
+  ;------------------------------------------------------------------------*/
+  
+  while(BlogCursorNext(cursor,&which))
+  {
+    BlogEntry *entry = BlogEntryRead(cursor->blog,&which);
+    if (entry != NULL)
+    {
+      if (entry->timestamp > cursor->blog->lastmod)
+        cursor->blog->lastmod = entry->timestamp;
+      return entry;
+    }
+  }
+  
+  return NULL;
+}
+
+/***********************************************************************/
+
+void BlogEntryStamp(Blog *blog,struct btm const *which,uint64_t *etag)
+{
+  static char const *const sidecars[] = { "" , ".comments" , ".webmention" , ".ad" };
+  
+  assert(blog  != NULL);
+  assert(which != NULL);
+  assert(etag  != NULL);
+  
+  /*------------------------------------------------------------------------
+  ; Everything that goes into rendering an entry, short of the templates,
+  ; lives in the entry file and its sidecar files, so the stat() data of
+  ; these is enough to tell if the rendered entry has changed.  A missing
+  ; file hashes as all zeros, so adding the first comment still changes the
+  ; result.  The latest of the times is also used for the Last-Modified
+  ; header.
+  ;-------------------------------------------------------------------------*/
+  
+  *etag = hash_mem(*etag,which,sizeof(struct btm));
+  
+  for (size_t i = 0 ; i < sizeof(sidecars) / sizeof(sidecars[0]) ; i++)
+  {
+    char        fname[FILENAME_MAX];
+    struct stat status;
+    long long   stamp[4];
+    
+    snprintf(
+        fname,
+        sizeof(fname),
+        "%04d/%02d/%02d/%d%s",
+        which->year,
+        which->month,
+        which->day,
+        which->part,
+        sidecars[i]
+    );
+    
+    if (stats_stat(fname,&status) == 0)
+    {
+      stamp[0] = status.st_mtim.tv_sec;
+      stamp[1] = status.st_mtim.tv_nsec;
+      stamp[2] = status.st_size;
+      stamp[3] = status.st_ino;
+      
+      if (status.st_mtime > blog->lastmod)
+        blog->lastmod = status.st_mtime;
+    }
+    else
+      memset(stamp,0,sizeof(stamp));
+      
+    *etag = hash_mem(*etag,stamp,sizeof(stamp));
+  }
+}
+
+/***********************************************************************/
+
+char *BlogSummaryRead(Blog *blog,size_t *psize)
+{
+  struct stat  status;
+  FILE        *in;
+  char        *text;
+  
+  assert(blog  != NULL);
+  assert(psize != NULL);
+  
+  if (stats_stat(".summary",&status) != 0)
+  {
+    int  lock = blog_lock(blog->config.lockfile);
+    bool okay = (stats_stat(".summary",&status) == 0)
+             || (summary_rebuild(blog) && (stats_stat(".summary",&status) == 0));
+             
+    blog_unlock(blog->config.lockfile,lock);
+    if (!okay)
+      return NULL;
+  }
+  
+  in = stats_fopen(".summary","r");
+  if (in == NULL)
+  {
+    syslog(LOG_ERR,".summary: %s",strerror(errno));
+    return NULL;
+  }
+  
+  text = malloc(status.st_size + 1);
+  if (text == NULL)
+  {
+    fclose(in);
+    return NULL;
+  }
+  
+  *psize = fread(text,1,status.st_size,in);
+  stats_read(*psize);
+  text[*psize] = '\0';
+  fclose(in);
+  
+  if (status.st_mtime > blog->lastmod)
+    blog->lastmod = status.st_mtime;
+    
+  return text;
+}
+
+/***********************************************************************/
+
+size_t BlogThisDay(Blog *blog,struct btm const *day,struct btm **plist)
+{
+  char        name[FILENAME_MAX];
+  struct btm *list;
+  size_t      num;
+  size_t      keep;
+  
+  assert(blog  != NULL);
+  assert(day   != NULL);
+  assert(plist != NULL);
+  
+  if (stats_access(".thisday",F_OK) != 0)
+  {
+    int lock = blog_lock(blog->config.lockfile);
+    
+    if (stats_access(".thisday",F_OK) != 0)
+      thisday_rebuild(blog);
+    blog_unlock(blog->config.lockfile,lock);
+  }
+  
+  /*-----------------------------------------------------------------------
+  ; If the index couldn't be built, fall back to checking each year.
+  ;------------------------------------------------------------------------*/
+  
+  if (stats_access(".thisday",F_OK) != 0)
+  {
+    struct btm when = *day;
+    
+    list = NULL;
+    num  = 0;
+    
+    for (when.year = blog->first.year ; when.year <= blog->now.year ; when.year++)
+    {
+      if (btm_cmp_date(&when,&blog->first) < 0)
+        continue;
+        
+      for (when.part = 1 ; BlogEntryExists(blog,&when) ; when.part++)
+      {
+        struct btm *n = realloc(list,(num + 1) * sizeof(struct btm));
+        if (n == NULL)
+          break;
+        list        = n;
+        list[num++] = when;
+      }
+    }
+    
+    *plist = list;
+    return num;
+  }
+  
+  thisday_name(name,sizeof(name),".thisday",day);
+  num = thisday_read(name,day,&list);
+  
+  /*-----------------------------------------------------------------------
+  ; Nothing past "now" is shown, as the page may be for an earlier date.
+  ;------------------------------------------------------------------------*/
+  
+  for (keep = 0 ; keep < num ; keep++)
+    if (list[keep].year > blog->now.year)
+      break;
+      
+  *plist = list;
+  return keep;
+}
+
+/***********************************************************************/
+
+size_t BlogClassEntries(Blog *blog,char const *tag,struct btm **plist)
+{
+  char name[FILENAME_MAX];
+  
+  assert(blog  != NULL);
+  assert(tag   != NULL);
+  assert(plist != NULL);
+  
+  if (stats_access(".class",F_OK) != 0)
+  {
+    int lock = blog_lock(blog->config.lockfile);
+    
+    if (stats_access(".class",F_OK) != 0)
+      class_rebuild(blog);
+    blog_unlock(blog->config.lockfile,lock);
+  }
+  
+  class_name(name,sizeof(name),".class",(String){ .s = strlen(tag) , .d = tag });
+  return class_read(name,plist);
+}
+
+/***********************************************************************/
+
+void BlogClassName(char *name,size_t size,char const *tag)
+{
+  assert(name != NULL);
+  assert(tag  != NULL);
+  
+  /*-----------------------------------------------------------------------
+  ; A name for a file after the tag, escaped as for the index but with '_'
+  ; (a '%' wouldn't survive being in a URL), so different tags still get
+  ; different names.
+  ;------------------------------------------------------------------------*/
+  
+  class_escape(name,size,(String){ .s = strlen(tag) , .d = tag },'_');
+}
+
+/***********************************************************************/
+
+static char *class_tag_find(char const *file)
+{
+  char         name[FILENAME_MAX];
+  char       **class;
+  struct btm  *list;
+  size_t       num;
+  size_t       numc;
+  char        *tag = NULL;
+  
+  assert(file != NULL);
+  
+  snprintf(name,sizeof(name),".class/%s",file);
+  num = class_read(name,&list);
+  if (num == 0)
+  {
+    free(list);
+    return NULL;
+  }
+  
+  numc = blog_meta_read(&class,"class",&list[0]);
+  
+  if ((size_t)list[0].part <= numc)
+  {
+    size_t  numtags;
+    String *tags = tag_split(&numtags,class[list[0].part - 1]);
+    
+    for (size_t i = 0 ; (tag == NULL) && (i < numtags) ; i++)
+    {
+      char cname[FILENAME_MAX];
+      
+      class_name(cname,sizeof(cname),".class",tags[i]);
+      if (strcmp(cname,name) == 0)
+        tag = fromstring(tags[i]);
+    }
+    
+    free(tags);
+  }
+  
+  if (class != NULL)
+  {
+    for (size_t i = 0 ; i < numc ; i++)
+      free(class[i]);
+    free(class);
+  }
+  
+  free(list);
+  return tag;
+}
+
+/***********************************************************************/
+
+size_t BlogClassTags(Blog *blog,char ***ptags)
+{
+  char          **tags = NULL;
+  size_t          num  = 0;
+  DIR            *dir;
+  struct dirent  *ent;
+  
+  assert(blog  != NULL);
+  assert(ptags != NULL);
+  
+  if (stats_access(".class",F_OK) != 0)
+  {
+    int lock = blog_lock(blog->config.lockfile);
+    
+    if (stats_access(".class",F_OK) != 0)
+      class_rebuild(blog);
+    blog_unlock(blog->config.lockfile,lock);
+  }
+  
+  /*-----------------------------------------------------------------------
+  ; The tags are the file names in the index, with the %XX undone.  They're
+  ; in lower case, which is fine, as lookups are done in lower case anyway.
+  ; A name cut short with a hash can't be undone, so that tag is looked up
+  ; from an entry that has it.
+  ;------------------------------------------------------------------------*/
+  
+  dir = opendir(".class");
+  if (dir != NULL)
+  {
+    while((ent = readdir(dir)) != NULL)
+    {
+      char  *tag;
+      char **n;
+      size_t len = 0;
+      
+      if (ent->d_name[0] == '.')
+        continue;
+      if ((strlen(ent->d_name) > 4) && (strcmp(&ent->d_name[strlen(ent->d_name) - 4],".new") == 0))
+        continue;
+        
+      if (strchr(ent->d_name,'~') != NULL)
+      {
+        tag = class_tag_find(ent->d_name);
+        if (tag == NULL)
+          continue;
+        n = realloc(tags,(num + 1) * sizeof(char *));
+        if (n == NULL)
+        {
+          free(tag);
+          break;
+        }
+        tags        = n;
+        tags[num++] = tag;
+        continue;
+      }
+      
+      tag = malloc(strlen(ent->d_name) + 1);
+      n   = realloc(tags,(num + 1) * sizeof(char *));
+      if ((tag == NULL) || (n == NULL))
+      {
+        free(tag);
+        if (n != NULL)
+          tags = n;
+        break;
+      }
+      tags = n;
+      
+      for (char const *p = ent->d_name ; *p != '\0' ; p++)
+      {
+        unsigned int c;
+        
+        if ((*p == '%') && (sscanf(p + 1,"%2x",&c) == 1))
+        {
+          tag[len++] = c;
+          p += 2;
+        }
+        else
+          tag[len++] = *p;
+      }
+      
+      tag[len]    = '\0';
+      tags[num++] = tag;
+    }
+    
+    closedir(dir);
+  }
+  
+  *ptags = tags;
+  return num;
+}
+
+/***********************************************************************/
+
+char *BlogClassesBetween(
+        Blog             *blog,
+        struct btm const *restrict start,
+        struct btm const *restrict end
+)
+{
+  BlogCursor   cursor;
+  struct btm   when;
+  struct btm   day;
+  char       **class = NULL;
+  size_t       numc  = 0;
+  char        *text  = NULL;
+  size_t       size  = 0;
+  bool         first = true;
+  FILE        *out;
+  
+  assert(blog  != NULL);
+  assert(start != NULL);
+  assert(end   != NULL);
+  
+  /*-----------------------------------------------------------------------
+  ; The class tags of every entry in the range, joined with commas.  Only
+  ; the class file of each day is read, not the entries themselves.
+  ;------------------------------------------------------------------------*/
+  
+  out = open_memstream(&text,&size);
+  if (out == NULL)
+    return NULL;
+    
+  memset(&day,0,sizeof(day));
+  BlogCursorInit(&cursor,blog,start,end,false);
+  
+  while(BlogCursorNext(&cursor,&when))
+  {
+    if (btm_cmp_date(&when,&day) != 0)
+    {
+      if (class != NULL)
+      {
+        for (size_t i = 0 ; i < numc ; i++)
+          free(class[i]);
+        free(class);
+      }
+      
+      numc = blog_meta_read(&class,"class",&when);
+      day  = when;
+    }
+    
+    if (((size_t)when.part <= numc) && (*class[when.part - 1] != '\0'))
+    {
+      fprintf(out,"%s%s",first ? "" : ", ",class[when.part - 1]);
+      first = false;
+    }
+  }
+  
+  if (class != NULL)
+  {
+    for (size_t i = 0 ; i < numc ; i++)
+      free(class[i]);
+    free(class);
+  }
+  
+  fclose(out);
+  return text;
+}
+
+/***********************************************************************/
+
+String *BlogEntryClasses(BlogEntry *entry,size_t *pnum)
+{
+  assert(entry != NULL);
+  assert(pnum  != NULL);
+  
+  /*-----------------------------------------------------------------------
+  ; The tags point into entry->class, so they're good as long as it is.
+  ;------------------------------------------------------------------------*/
+  
+  if ((entry->classes == NULL) && (entry->class != NULL))
+    entry->classes = tag_split(&entry->classnum,entry->class);
+    
+  *pnum = entry->classnum;
+  return entry->classes;
+}
+
+/***********************************************************************/
+
+aflink__t *BlogAffiliate(Blog const *blog,char const *proto,size_t len)
+{
+  size_t h;
+  
+  assert(blog  != NULL);
+  assert(proto != NULL);
+  
+  if (blog->config.afhashsize == 0)
+    return NULL;
+    
+  h = hash_mem(HASH_INIT,proto,len) & (blog->config.afhashsize - 1);
+  
+  while(blog->config.afhash[h] != NULL)
+  {
+    aflink__t *aff = blog->config.afhash[h];
+    
+    if ((aff->psize == len) && (memcmp(aff->proto,proto,len) == 0))
+      return aff;
+    h = (h + 1) & (blog->config.afhashsize - 1);
+  }
+  
+  return NULL;
 }
 
 /***********************************************************************/
@@ -1253,6 +3097,7 @@ int BlogEntryFree(BlogEntry *entry)
   free(entry->adtag);
   free(entry->status);
   free(entry->author);
+  free(entry->classes);
   free(entry->class);
   free(entry->title);
   free(entry);
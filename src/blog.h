@@ -24,12 +24,14 @@
 #define I_A7907483_71BF_5594_9AA6_58C785CB9FFA
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 
 #include <lua.h>
 #include <cgilib8/nodelist.h>
 
 #include "timeutil.h"
+#include "blogutil.h"
 
 /*******************************************************************/
 
@@ -54,6 +56,7 @@ typedef struct template
   char const *file;
   char const *posthook;
   char const *pagegen;
+  char const *class;    /* tag of the page for a "class" template */
   size_t      items;
   bool        reverse;
   bool        fullurl;
@@ -77,6 +80,9 @@ struct config
   char const    *url;
   char const    *prehook;
   char const    *posthook;
+  char const    *hookspool; /* queue hooks here, NULL = run them now */
+  size_t         hookjobs;
+  size_t         hookretries;
   char const    *adtag;
   char const    *conversion;
   struct author  author;
@@ -84,6 +90,10 @@ struct config
   size_t         templatenum;
   aflink__t     *affiliates;
   size_t         affiliatenum;
+  aflink__t    **afhash;   /* derived from affiliates, keyed by proto   */
+  size_t         afhashsize;
+  size_t         rangemax; /* max entries per range page, 0 = no limit */
+  char const    *stats;    /* "syslog" or file for timing records     */
   char const    *baseurl; /* derived from URL */
   lua_State     *L;
 };
@@ -111,20 +121,47 @@ typedef struct blogentry
   char       *status;
   char       *adtag;
   char       *body;
+  String     *classes;  /* class split into tags, on demand */
+  size_t      classnum;
 } BlogEntry;
 
+typedef struct blogcursor
+{
+  Blog       *blog;
+  struct btm  current;  /* next candidate entry          */
+  struct btm  start;
+  struct btm  end;
+  bool        reverse;
+} BlogCursor;
+
 /*********************************************************************/
 
 extern Blog      *BlogNew               (char const *);
 extern void       BlogFree              (Blog *);
+extern int        BlogLock              (Blog *);
+extern void       BlogUnlock            (Blog *,int);
 extern BlogEntry *BlogEntryNew          (Blog *);
 extern BlogEntry *BlogEntryRead         (Blog *,struct btm const *);
 extern void       BlogEntryReadBetweenU (Blog *,List *,struct btm const *restrict,struct btm const *restrict);
 extern void       BlogEntryReadBetweenD (Blog *,List *,struct btm const *restrict,struct btm const *restrict);
 extern void       BlogEntryReadXD       (Blog *,List *,struct btm const *,size_t);
 extern void       BlogEntryReadXU       (Blog *,List *,struct btm const *,size_t);
-extern int        BlogEntryWrite        (BlogEntry *);
+extern int        BlogEntryWrite        (BlogEntry *,char **);
+extern int        BlogEntryWriteBatch   (Blog *,BlogEntry *[],size_t);
 extern size_t     BlogLastEntry         (Blog *,struct btm const *);
+extern void       BlogEntryStamp        (Blog *,struct btm const *,uint64_t *);
+extern bool       BlogEntryExists       (Blog *,struct btm const *);
+extern void       BlogCursorInit        (BlogCursor *,Blog *,struct btm const *restrict,struct btm const *restrict,bool);
+extern bool       BlogCursorNext        (BlogCursor *,struct btm *);
+extern BlogEntry *BlogCursorRead        (BlogCursor *);
+extern String    *BlogEntryClasses      (BlogEntry *,size_t *);
+extern aflink__t *BlogAffiliate         (Blog const *,char const *,size_t);
+extern char      *BlogSummaryRead       (Blog *,size_t *);
+extern size_t     BlogThisDay           (Blog *,struct btm const *,struct btm **);
+extern size_t     BlogClassEntries      (Blog *,char const *,struct btm **);
+extern size_t     BlogClassTags         (Blog *,char ***);
+extern char      *BlogClassesBetween    (Blog *,struct btm const *restrict,struct btm const *restrict);
+extern void       BlogClassName         (char *,size_t,char const *);
 extern int        BlogEntryFree         (BlogEntry *);
 
 /**********************************************************************/
@@ -106,3 +106,25 @@ size_t fcopy(FILE *restrict out,FILE *restrict in)
 }
 
 /*********************************************************************/
+
+uint64_t hash_mem(uint64_t hash,void const *data,size_t size)
+{
+  unsigned char const *p = data;
+  
+  assert(data != NULL);
+  
+  /*---------------------------------------------------------------------
+  ; FNV-1a---simple, fast and good enough for ETags and hash tables.  Start
+  ; with HASH_INIT and feed the result back in to hash more data.
+  ;----------------------------------------------------------------------*/
+  
+  while(size--)
+  {
+    hash ^= *p++;
+    hash *= 0x100000001B3uLL;
+  }
+  
+  return hash;
+}
+
+/*********************************************************************/
@@ -24,6 +24,9 @@
 #define I_F4A408FA_A630_59FB_81C6_846355DD0AFB
 
 #include <stdio.h>
+#include <stdint.h>
+
+#define HASH_INIT       0xCBF29CE484222325uLL
 
 /*********************************************************************/
 
@@ -35,8 +38,9 @@ typedef struct mystring
 
 /*********************************************************************/
 
-extern String *tag_split  (size_t *,char const *);
-extern char   *fromstring (String const);
-extern size_t  fcopy      (FILE *restrict,FILE *restrict);
+extern String  *tag_split  (size_t *,char const *);
+extern char    *fromstring (String const);
+extern size_t   fcopy      (FILE *restrict,FILE *restrict);
+extern uint64_t hash_mem   (uint64_t,void const *,size_t);
 
 #endif
@@ -37,6 +37,7 @@
 #include "backend.h"
 #include "blogutil.h"
 #include "conversion.h"
+#include "stats.h"
 
 /*****************************************************************/
 
@@ -143,25 +144,23 @@ static void handle_aflinks(HtmlToken token,char const *attrib,Blog *blog)
   struct pair *src = HtmlParseGetPair(token,attrib);
   if (src != NULL)
   {
-    for (size_t i = 0 ; i < blog->config.affiliatenum ; i++)
+    char const *colon = strchr(src->value,':');
+    aflink__t  *aff;
+    
+    if (colon == NULL)
+      return;
+      
+    aff = BlogAffiliate(blog,src->value,(size_t)(colon - src->value));
+    if (aff != NULL)
     {
-      if (strncmp(src->value,blog->config.affiliates[i].proto,blog->config.affiliates[i].psize) == 0)
-      {
-        char buffer[BUFSIZ];
-        struct pair *np;
-        
-        snprintf(
-                buffer,
-                sizeof(buffer),
-                blog->config.affiliates[i].format,
-                &src->value[blog->config.affiliates[i].psize + 1]
-        );
-        np = PairCreate(attrib,buffer);
-        NodeInsert(&src->node,&np->node);
-        NodeRemove(&src->node);
-        PairFree(src);
-        return;
-      }
+      char buffer[BUFSIZ];
+      struct pair *np;
+      
+      snprintf(buffer,sizeof(buffer),aff->format,colon + 1);
+      np = PairCreate(attrib,buffer);
+      NodeInsert(&src->node,&np->node);
+      NodeRemove(&src->node);
+      PairFree(src);
     }
   }
 }
@@ -269,6 +268,28 @@ static void output_entify(char const *msg,FILE *out)
   fclose(tmp);
 }
 
+/*************************************************************************/
+
+static BlogEntry *cbd_next_entry(struct callback_data *cbd)
+{
+  assert(cbd != NULL);
+  
+  /*------------------------------------------------------------------------
+  ; Entries already read in come first.  After that, if there's a cursor,
+  ; read the rest in one at a time as they're rendered, so a large range
+  ; only ever has one entry in memory.
+  ;-------------------------------------------------------------------------*/
+  
+  BlogEntry *entry = (BlogEntry *)ListRemHead(&cbd->list);
+  
+  if (NodeValid(&entry->node))
+    return entry;
+  else if (cbd->cursor != NULL)
+    return BlogCursorRead(cbd->cursor);
+  else
+    return NULL;
+}
+  
 /***************************************************************
 * TEMPLATE CALL BACK FUNCTIONS
 ****************************************************************/
@@ -292,7 +313,7 @@ static void cb_ad(FILE *out,void *data)
         cbd->entry->when.part
   );
   
-  cbd->ad = fopen(fname,"r");
+  cbd->ad = stats_fopen(fname,"r");
   if (cbd->ad == NULL) return;
   generic_cb("ad",out,data);
   fclose(cbd->ad);
@@ -312,7 +333,7 @@ static void cb_ad_content(FILE *out,void *data)
   ; we might also do a generic_cb() here
   ;--------------------------------------*/
   
-  fcopy(out,cbd->ad);
+  stats_read(fcopy(out,cbd->ad));
 }
 
 /*********************************************************************/
@@ -326,7 +347,7 @@ static void cb_atom_categories(FILE *out,void *data)
   assert(out  != NULL);
   assert(data != NULL);
   
-  cats = tag_split(&num,cbd->entry->class);
+  cats = BlogEntryClasses(cbd->entry,&num);
   
   for (size_t i = 0 ; i < num ; i++)
   {
@@ -335,8 +356,6 @@ static void cb_atom_categories(FILE *out,void *data)
     free(cbd->adcat);
     cbd->adcat = NULL;
   }
-  
-  free(cats);
 }
 
 /************************************************************************/
@@ -372,9 +391,9 @@ static void cb_atom_entry(FILE *out,void *data)
   
   for
   (
-    entry = (BlogEntry *)ListRemHead(&cbd->list);
-    NodeValid(&entry->node);
-    entry = (BlogEntry *)ListRemHead(&cbd->list)
+    entry = cbd_next_entry(cbd);
+    entry != NULL;
+    entry = cbd_next_entry(cbd)
   )
   {
     assert(entry->valid);
@@ -604,9 +623,9 @@ static void cb_comments_body(FILE *out,void *data)
         cbd->entry->when.part
   );
   
-  in = fopen(fname,"r");
+  in = stats_fopen(fname,"r");
   if (in == NULL) return;
-  fcopy(out,in);
+  stats_read(fcopy(out,in));
   fclose(in);
 }
 
@@ -630,7 +649,7 @@ static void cb_comments_check(FILE *out,void *data)
         cbd->entry->when.part
   );
   
-  if (access(fname,R_OK) < 0)
+  if (stats_access(fname,R_OK) < 0)
     fputs("No ",out);
     
   fputs("Comments",out);
@@ -665,7 +684,16 @@ static void cb_cond_hr(FILE *out,void *data)
   assert(out  != NULL);
   assert(data != NULL);
   
-  if (cbd->request->f.navigation && (cbd->navunit == UNIT_PART))
+  /*----------------------------------------------------------------------
+  ; A single entry doesn't need a rule, but a page of a range does.
+  ;-----------------------------------------------------------------------*/
+  
+  if (
+       cbd->request->f.navigation
+       && (cbd->navunit  == UNIT_PART)
+       && (cbd->prevpage == NULL)
+       && (cbd->nextpage == NULL)
+     )
     return;
     
   entry = cbd->entry;
@@ -863,15 +891,15 @@ static void cb_entry(FILE *out,void *data)
   
   if (cbd->request->f.htmldump)
   {
-    fcopy(out,stdin);
+    stats_read(fcopy(out,stdin));
     return;
   }
   
   for
   (
-    entry = (BlogEntry *)ListRemHead(&cbd->list);
-    NodeValid(&entry->node);
-    entry = (BlogEntry *)ListRemHead(&cbd->list)
+    entry = cbd_next_entry(cbd);
+    entry != NULL;
+    entry = cbd_next_entry(cbd)
   )
   {
     assert(entry->valid);
@@ -923,6 +951,8 @@ static void cb_entry_body(FILE *out,void *data)
     return;
   }
   
+  stats_start(STAGE_BODY);
+  
   while((t = HtmlParseNext(token)) != T_EOF)
   {
     if (t == T_TAG)
@@ -993,6 +1023,7 @@ static void cb_entry_body(FILE *out,void *data)
   
   HtmlParseFree(token);
   fclose(in);
+  stats_stop(STAGE_BODY);
 }
 
 /**********************************************************************/
@@ -1059,7 +1090,7 @@ static void cb_entry_class_jsonified(FILE *out,void *data)
   assert(out  != NULL);
   assert(data != NULL);
   
-  cats = tag_split(&num,cbd->entry->class);
+  cats = BlogEntryClasses(cbd->entry,&num);
   for (size_t i = 0 ; i < num ; i++)
   {
     fputc('"',out);
@@ -1073,8 +1104,6 @@ static void cb_entry_class_jsonified(FILE *out,void *data)
     if (i < num - 1)
       fputc(',',out);
   }
-  
-  free(cats);
 }
 
 /***********************************************************************/
@@ -1321,9 +1350,9 @@ static void cb_json_item(FILE *out,void *data)
   
   for
   (
-    BlogEntry *entry = (BlogEntry *)ListRemHead(&cbd->list);
-    NodeValid(&entry->node);
-    entry = (BlogEntry *)ListRemHead(&cbd->list)
+    BlogEntry *entry = cbd_next_entry(cbd);
+    entry != NULL;
+    entry = cbd_next_entry(cbd)
   )
   {
     assert(entry->valid);
@@ -1517,7 +1546,10 @@ static void cb_navigation_next_url(FILE *out,void *data)
   assert(out  != NULL);
   assert(data != NULL);
   
-  print_nav_url(out,&cbd->next,cbd->navunit,cbd->blog->config.baseurl);
+  if (cbd->nextpage != NULL)
+    fprintf(out,"%s%s",cbd->blog->config.baseurl,cbd->nextpage);
+  else
+    print_nav_url(out,&cbd->next,cbd->navunit,cbd->blog->config.baseurl);
 }
 
 /*******************************************************************/
@@ -1541,7 +1573,10 @@ static void cb_navigation_prev_url(FILE *out,void *data)
   assert(out  != NULL);
   assert(data != NULL);
   
-  print_nav_url(out,&cbd->previous,cbd->navunit,cbd->blog->config.baseurl);
+  if (cbd->prevpage != NULL)
+    fprintf(out,"%s%s",cbd->blog->config.baseurl,cbd->prevpage);
+  else
+    print_nav_url(out,&cbd->previous,cbd->navunit,cbd->blog->config.baseurl);
 }
 
 /********************************************************************/
@@ -1558,6 +1593,174 @@ static void cb_now_year(FILE *out,void *data)
 
 /*******************************************************************/
 
+static void cb_overview(FILE *out,void *data)
+{
+  struct callback_data *cbd = data;
+  
+  assert(out  != NULL);
+  assert(data != NULL);
+  
+  if (cbd->summary == NULL) return;
+  generic_cb("overview",out,data);
+}
+
+/*******************************************************************/
+
+static void cb_overview_cond_month(FILE *out,void *data)
+{
+  struct callback_data *cbd = data;
+  
+  assert(out  != NULL);
+  assert(data != NULL);
+  
+  if (btm_cmp_month(&cbd->entry->when,&cbd->last) != 0)
+    generic_cb("overview.cond.month",out,data);
+}
+
+/*******************************************************************/
+
+static void cb_overview_cond_year(FILE *out,void *data)
+{
+  struct callback_data *cbd = data;
+  
+  assert(out  != NULL);
+  assert(data != NULL);
+  
+  if (btm_cmp_year(&cbd->entry->when,&cbd->last) != 0)
+    generic_cb("overview.cond.year",out,data);
+}
+
+/*******************************************************************/
+
+static void cb_overview_item(FILE *out,void *data)
+{
+  static char           empty[] = "";
+  struct callback_data *cbd     = data;
+  BlogEntry             entry;
+  char                  title[BUFSIZ];
+  char const           *line;
+  size_t                plen;
+  
+  assert(out  != NULL);
+  assert(data != NULL);
+  assert(cbd->summary != NULL);
+  
+  /*-----------------------------------------------------------------------
+  ; Each line of the summary is turned into an entry with just the date and
+  ; title filled in, so the usual entry callbacks can be used.
+  ;------------------------------------------------------------------------*/
+  
+  memset(&entry,0,sizeof(entry));
+  entry.valid  = true;
+  entry.blog   = cbd->blog;
+  entry.title  = title;
+  entry.class  = empty;
+  entry.author = empty;
+  entry.status = empty;
+  entry.adtag  = empty;
+  entry.body   = empty;
+  plen         = cbd->prefix != NULL ? strlen(cbd->prefix) : 0;
+  
+  memset(&cbd->last,0,sizeof(cbd->last));
+  
+  for (line = cbd->summary ; *line != '\0' ; )
+  {
+    char const *eol = strchr(line,'\n');
+    size_t      len = eol != NULL ? (size_t)(eol - line) : strlen(line);
+    char const *tab = memchr(line,'\t',len);
+    
+    if (
+         (tab != NULL)
+         && (
+              (plen == 0)
+              || (
+                   (len > plen)
+                   && (memcmp(line,cbd->prefix,plen) == 0)
+                   && ((cbd->prefix[plen - 1] == '/') || (strchr("/.\t",line[plen]) != NULL))
+                 )
+            )
+         && (sscanf(line,"%d/%d/%d.%d",&entry.when.year,&entry.when.month,&entry.when.day,&entry.when.part) == 4)
+       )
+    {
+      size_t tlen = len - (size_t)(tab + 1 - line);
+      
+      if (tlen >= sizeof(title))
+        tlen = sizeof(title) - 1;
+      memcpy(title,tab + 1,tlen);
+      title[tlen] = '\0';
+      
+      cbd->entry = &entry;
+      generic_cb("overview.item",out,data);
+      cbd->last = entry.when;
+    }
+    
+    line += len;
+    if (*line == '\n')
+      line++;
+  }
+  
+  cbd->entry = NULL;
+}
+
+/*******************************************************************/
+
+static void cb_overview_month(FILE *out,void *data)
+{
+  struct callback_data *cbd = data;
+  struct tm             day;
+  char                  buffer[BUFSIZ];
+  
+  assert(out  != NULL);
+  assert(data != NULL);
+  
+  tm_init(&day);
+  day.tm_year = cbd->entry->when.year - 1900;
+  day.tm_mon  = cbd->entry->when.month - 1;
+  day.tm_mday = 1;
+  
+  mktime(&day);
+  strftime(buffer,sizeof(buffer),"%B",&day);
+  fputs(buffer,out);
+}
+
+/*******************************************************************/
+
+static void cb_overview_month_url(FILE *out,void *data)
+{
+  struct callback_data *cbd = data;
+  
+  assert(out  != NULL);
+  assert(data != NULL);
+  
+  print_nav_url(out,&cbd->entry->when,UNIT_MONTH,cbd->blog->config.baseurl);
+}
+
+/*******************************************************************/
+
+static void cb_overview_year(FILE *out,void *data)
+{
+  struct callback_data *cbd = data;
+  
+  assert(out  != NULL);
+  assert(data != NULL);
+  
+  fprintf(out,"%04d",cbd->entry->when.year);
+}
+
+/*******************************************************************/
+
+static void cb_overview_year_url(FILE *out,void *data)
+{
+  struct callback_data *cbd = data;
+  
+  assert(out  != NULL);
+  assert(data != NULL);
+  
+  print_nav_url(out,&cbd->entry->when,UNIT_YEAR,cbd->blog->config.baseurl);
+}
+
+/*******************************************************************/
+
 static void cb_request_url(FILE *out,void *data)
 {
   struct callback_data *cbd = data;
@@ -1597,9 +1800,9 @@ static void cb_rss_item(FILE *out,void *data)
   
   for
   (
-    BlogEntry *entry = (BlogEntry *)ListRemHead(&cbd->list);
-    NodeValid(&entry->node);
-    entry = (BlogEntry *)ListRemHead(&cbd->list)
+    BlogEntry *entry = cbd_next_entry(cbd);
+    entry != NULL;
+    entry = cbd_next_entry(cbd)
   )
   {
     assert(entry->valid);
@@ -1689,7 +1892,7 @@ static void cb_webmention(FILE *out,void *data)
          cbd->entry->when.part
   );
   
-  cbd->wm = fopen(fname,"r");
+  cbd->wm = stats_fopen(fname,"r");
   if (cbd->wm == NULL) return;
   rc = fcntl(
               fileno(cbd->wm),
@@ -1739,6 +1942,7 @@ static void cb_webmention_item(FILE *out,void *data)
   
   while((len = getline(&cbd->wmurl,&buflen,cbd->wm)) != -1)
   {
+    stats_read(len);
     char *p = strchr(cbd->wmurl,'\t');
     if (p == NULL)
       cbd->wmtitle = cbd->wmurl;
@@ -1872,6 +2076,14 @@ void generic_cb(char const *which,FILE *out,void *data)
     { "navigation.prev.title"  , cb_navigation_prev_title  } ,
     { "navigation.prev.url"    , cb_navigation_prev_url    } ,
     { "now.year"               , cb_now_year               } ,
+    { "overview"               , cb_overview               } , /* template "overview" */
+    { "overview.cond.month"    , cb_overview_cond_month    } , /* template "overview.cond.month" */
+    { "overview.cond.year"     , cb_overview_cond_year     } , /* template "overview.cond.year" */
+    { "overview.item"          , cb_overview_item          } , /* template "overview.item" */
+    { "overview.month"         , cb_overview_month         } ,
+    { "overview.month.url"     , cb_overview_month_url     } ,
+    { "overview.year"          , cb_overview_year          } ,
+    { "overview.year.url"      , cb_overview_year_url      } ,
     { "request.url"            , cb_request_url            } ,
     { "robots.index"           , cb_robots_index           } ,
     { "rss.item"               , cb_rss_item               } , /* template "item" */
@@ -1892,10 +2104,114 @@ void generic_cb(char const *which,FILE *out,void *data)
   
   struct callback_data *cbd = data;
   
+  stats_start(STAGE_TEMPLATE);
   Chunk templates = ChunkNew(cbd->template->template,callbacks,sizeof(callbacks) / sizeof(callbacks[0]));
   ChunkProcess(templates,which,out,data);
   ChunkFree(templates);
   fflush(out);
+  stats_stop(STAGE_TEMPLATE);
+}
+
+/*********************************************************************/
+
+static bool etag_match(char const *inm,char const *etag)
+{
+  size_t len;
+  
+  assert(inm  != NULL);
+  assert(etag != NULL);
+  
+  /*-----------------------------------------------------------------------
+  ; If-None-Match is a list of (possibly weak) entity tags, or "*".  Weak
+  ; comparison is used, so any W/ prefix is skipped.
+  ;------------------------------------------------------------------------*/
+  
+  len = strlen(etag);
+  
+  while(*inm)
+  {
+    while(isspace((unsigned char)*inm) || (*inm == ','))
+      inm++;
+      
+    if (*inm == '*')
+      return true;
+      
+    if ((inm[0] == 'W') && (inm[1] == '/'))
+      inm += 2;
+      
+    if ((strncmp(inm,etag,len) == 0) && ((inm[len] == '\0') || (inm[len] == ',') || isspace((unsigned char)inm[len])))
+      return true;
+      
+    while(*inm && (*inm != ','))
+      inm++;
+  }
+  
+  return false;
+}
+
+/*********************************************************************/
+
+static void etag_text(char *dest,size_t size,uint64_t etag)
+{
+  assert(dest != NULL);
+  snprintf(dest,size,"\"%016llx\"",(unsigned long long)etag);
+}
+
+/*********************************************************************/
+
+static bool not_modified(FILE *out,struct callback_data *cbd,char const *etag)
+{
+  char const *inm;
+  bool        notmodified;
+  char        buf[64];
+  
+  assert(out  != NULL);
+  assert(cbd  != NULL);
+  assert(etag != NULL);
+  
+  if (!cbd->request->f.cgiget || (cbd->status != HTTP_OKAY))
+    return false;
+    
+  /*---------------------------------------------------------------------
+  ; RFC-7232: If-None-Match takes precedence over If-Modified-Since.
+  ;----------------------------------------------------------------------*/
+  
+  inm = getenv("HTTP_IF_NONE_MATCH");
+  
+  if ((cbd->etag != 0) && (inm != NULL))
+    notmodified = etag_match(inm,etag);
+  else
+    notmodified = HttpNotModified(cbd->blog->lastmod);
+    
+  if (notmodified)
+  {
+    fprintf(
+      out,
+      "Status: %d\r\n"
+      "Content-Length: 0\r\n"
+      "Last-Modified: %s\r\n",
+      HTTP_NOTMODIFIED,
+      HttpTimeStamp(buf,64,cbd->blog->lastmod)
+    );
+    if (cbd->etag != 0)
+      fprintf(out,"ETag: %s\r\n",etag);
+    fputs("\r\n",out);
+  }
+  
+  return notmodified;
+}
+
+/*********************************************************************/
+
+bool generic_not_modified(FILE *out,struct callback_data *cbd)
+{
+  char etag[24];
+  
+  assert(out != NULL);
+  assert(cbd != NULL);
+  
+  etag_text(etag,sizeof(etag),cbd->etag);
+  return not_modified(out,cbd,etag);
 }
 
 /*********************************************************************/
@@ -1903,35 +2219,28 @@ void generic_cb(char const *which,FILE *out,void *data)
 void generic_main(FILE *out,struct callback_data *cbd)
 {
   char buf[64];
+  char etag[24];
   
   assert(out != NULL);
   assert(cbd != NULL);
   
   if (cbd->request->f.cgiget)
   {
-    if ((cbd->status == HTTP_OKAY) && HttpNotModified(cbd->blog->lastmod))
-    {
-      fprintf(
-        out,
-        "Status: %d\r\n"
-        "Content-Length: 0\r\n"
-        "Last-Modified: %s\r\n"
-        "\r\n",
-        HTTP_NOTMODIFIED,
-        HttpTimeStamp(buf,64,cbd->blog->lastmod)
-      );
+    etag_text(etag,sizeof(etag),cbd->etag);
+    if (not_modified(out,cbd,etag))
       return;
-    }
-    
+      
     fprintf(
         out,
         "Status: %d\r\n"
         "Content-Type: text/html\r\n"
-        "Last-Modified: %s\r\n"
-        "\r\n",
+        "Last-Modified: %s\r\n",
         cbd->status,
         HttpTimeStamp(buf,64,cbd->blog->lastmod)
     );
+    if (cbd->etag != 0)
+      fprintf(out,"ETag: %s\r\n",etag);
+    fputs("\r\n",out);
   }
   generic_cb("main",out,cbd);
 }
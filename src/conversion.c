@@ -27,28 +27,127 @@
 
 #include "conversion.h"
 
+/*********************************************************************
+*
+* JSON strings have to be UTF-8, so a valid UTF-8 sequence is passed along
+* as is and any other byte above 127 goes out as \u00XX (as if it were
+* ISO-8859-1, which older entries likely are).  A sequence can be split
+* between writes, so the start of one is held back until it's complete,
+* or proven not to be; anything still held when the stream is closed goes
+* out byte by byte.
+*
+**********************************************************************/
+
+struct fjson
+{
+  FILE          *realout;
+  unsigned char  seq[4];
+  size_t         len;
+  size_t         need;
+};
+
+/*********************************************************************/
+
+static size_t fj_seqlen(unsigned char c)
+{
+  if ((c >= 0xC2) && (c <= 0xDF)) return 2;
+  if ((c >= 0xE0) && (c <= 0xEF)) return 3;
+  if ((c >= 0xF0) && (c <= 0xF4)) return 4;
+  return 0;
+}
+
+/*********************************************************************/
+
+static bool fj_continues(struct fjson const *fj,unsigned char c)
+{
+  assert(fj      != NULL);
+  assert(fj->len >  0);
+  
+  if ((c & 0xC0) != 0x80)
+    return false;
+    
+  /*-------------------------------------------------------------------
+  ; The second byte also rules out overlong forms, surrogates and code
+  ; points past U+10FFFF.
+  ;--------------------------------------------------------------------*/
+  
+  if (fj->len == 1)
+  {
+    switch(fj->seq[0])
+    {
+      case 0xE0: return c >= 0xA0;
+      case 0xED: return c <= 0x9F;
+      case 0xF0: return c >= 0x90;
+      case 0xF4: return c <= 0x8F;
+      default:   break;
+    }
+  }
+  
+  return true;
+}
+
+/*********************************************************************/
+
+static void fj_drain(struct fjson *fj)
+{
+  assert(fj != NULL);
+  
+  for (size_t i = 0 ; i < fj->len ; i++)
+    fprintf(fj->realout,"\\u%04X",fj->seq[i]);
+  fj->len = 0;
+}
+
 /*********************************************************************/
 
 static ssize_t fj_write(void *cookie,char const *buffer,size_t bytes)
 {
-  FILE *realout = cookie;
-  size_t size   = bytes;
+  struct fjson *fj   = cookie;
+  size_t        size = bytes;
   
   assert(cookie != NULL);
   assert(buffer != NULL);
   
   while(size)
   {
-    switch(*buffer)
+    unsigned char c = *buffer;
+    
+    if (fj->len > 0)
+    {
+      if (fj_continues(fj,c))
+      {
+        fj->seq[fj->len++] = c;
+        if (fj->len == fj->need)
+        {
+          fwrite(fj->seq,1,fj->len,fj->realout);
+          fj->len = 0;
+        }
+        buffer++;
+        size--;
+        continue;
+      }
+      
+      fj_drain(fj);
+    }
+    
+    switch(c)
     {
-      case '"' : fputc('\\',realout); fputc(*buffer,realout); break;
-      case '\\': fputc('\\',realout); fputc(*buffer,realout); break;
-      case '\b': fputc('\\',realout); fputc('b',realout);     break;
-      case '\f': fputc('\\',realout); fputc('f',realout);     break;
-      case '\n': fputc('\\',realout); fputc('n',realout);     break;
-      case '\r': fputc('\\',realout); fputc('r',realout);     break;
-      case '\t': fputc('\\',realout); fputc('t',realout);     break;
-      default:   fputc(*buffer,realout);                      break;
+      case '"' : fputc('\\',fj->realout); fputc(c,fj->realout);   break;
+      case '\\': fputc('\\',fj->realout); fputc(c,fj->realout);   break;
+      case '\b': fputc('\\',fj->realout); fputc('b',fj->realout); break;
+      case '\f': fputc('\\',fj->realout); fputc('f',fj->realout); break;
+      case '\n': fputc('\\',fj->realout); fputc('n',fj->realout); break;
+      case '\r': fputc('\\',fj->realout); fputc('r',fj->realout); break;
+      case '\t': fputc('\\',fj->realout); fputc('t',fj->realout); break;
+      default:
+           if (c < 0x20)
+             fprintf(fj->realout,"\\u%04X",c);
+           else if (c < 0x80)
+             fputc(c,fj->realout);
+           else if ((fj->need = fj_seqlen(c)) > 0)
+             fj->seq[fj->len++] = c;
+           else
+             fprintf(fj->realout,"\\u%04X",c);
+           break;
     }
     buffer++;
     size--;
@@ -59,15 +158,42 @@ static ssize_t fj_write(void *cookie,char const *buffer,size_t bytes)
 
 /*********************************************************************/
 
+static int fj_close(void *cookie)
+{
+  struct fjson *fj = cookie;
+  
+  assert(cookie != NULL);
+  
+  fj_drain(fj);
+  free(fj);
+  return 0;
+}
+
+/*********************************************************************/
+
 FILE *fjson_encode_onwrite(FILE *out)
 {
+  struct fjson *fj;
+  FILE         *jout;
+  
   assert(out != NULL);
-  return fopencookie(out,"w",(cookie_io_functions_t) {
-                               NULL,
-                               fj_write,
-                               NULL,
-                               NULL
-                             });
+  
+  fj = malloc(sizeof(struct fjson));
+  if (fj == NULL)
+    return NULL;
+    
+  fj->realout = out;
+  fj->len     = 0;
+  fj->need    = 0;
+  jout        = fopencookie(fj,"w",(cookie_io_functions_t) {
+                                     NULL,
+                                     fj_write,
+                                     NULL,
+                                     fj_close
+                                   });
+  if (jout == NULL)
+    free(fj);
+  return jout;
 }
 
 /*********************************************************************/
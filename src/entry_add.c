@@ -25,10 +25,48 @@
 #include <errno.h>
 
 #include <syslog.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <cgilib8/util.h>
 
 #include "backend.h"
 
+/*********************************************************************
+*
+* The body and the meta data of an entry are handed to the prehook as
+* files, which are kept in memory (or if that isn't supported, as an
+* unnamed temporary file) and passed by the name of the open descriptor
+* (/dev/fd/N), which the hook inherits.  Opening one of those names gets a
+* new file position, so the hook can read them as if they were ordinary
+* files.  Nothing is left behind to clean up, and there's no window
+* between picking a name and creating the file for someone else to get in.
+*
+**********************************************************************/
+
+static FILE *prehook_file(char const *name,char *path,size_t size)
+{
+  FILE *fp = NULL;
+  int   fh;
+  
+  assert(name != NULL);
+  assert(path != NULL);
+  assert(size >  0);
+  
+  fh = memfd_create(name,0);
+  if (fh != -1)
+  {
+    fp = fdopen(fh,"w+");
+    if (fp == NULL)
+      close(fh);
+  }
+  else
+    fp = tmpfile();
+    
+  if (fp != NULL)
+    snprintf(path,size,"/dev/fd/%d",fileno(fp));
+  return fp;
+}
+
 /*********************************************************************/
 
 http__e entry_add(Blog *blog,Request *req)
@@ -41,71 +79,74 @@ http__e entry_add(Blog *blog,Request *req)
   
   if (emptynull_string(req->body))
     return HTTP_BADREQ;
-  
+    
   if (!authenticate_author(blog,req))
     return HTTP_UNAUTHORIZED;
     
   if (blog->config.prehook != NULL)
   {
-    FILE *fp;
-    char  fnbody[L_tmpnam];
-    char  fnmeta[L_tmpnam];
+    FILE *fpbody;
+    FILE *fpmeta;
+    char  fnbody[32];
+    char  fnmeta[32];
+    char  ts[12];
     bool  rc;
     
-    tmpnam(fnbody);
-    tmpnam(fnmeta);
-    
-    fp = fopen(fnbody,"w");
-    if (fp != NULL)
-    {
-      fputs(req->body,fp);
-      fclose(fp);
-    }
-    else
+    fpbody = prehook_file("entry-body",fnbody,sizeof(fnbody));
+    if (fpbody == NULL)
     {
       syslog(LOG_ERR,"entry_add: tmp-body: %s",strerror(errno));
       return HTTP_ISERVERERR;
     }
     
-    fp = fopen(fnmeta,"w");
-    if (fp != NULL)
+    fpmeta = prehook_file("entry-meta",fnmeta,sizeof(fnmeta));
+    if (fpmeta == NULL)
     {
-      char ts[12];
-      
-      if (req->date == NULL)
-        snprintf(ts,sizeof(ts),"%04d/%02d/%02d",blog->now.year,blog->now.month,blog->now.day);
-      else
-        snprintf(ts,sizeof(ts),"%s",req->date);
-        
-      fprintf(
-        fp,
-        "Author: %s\n"
-        "Title: %s\n"
-        "Class: %s\n"
-        "Status: %s\n"
-        "Date: %s\n"
-        "Adtag: %s\n"
-        "\n",
-        req->author,
-        req->title,
-        req->class,
-        req->status,
-        ts,
-        req->adtag
-      );
-      fclose(fp);
+      fclose(fpbody);
+      syslog(LOG_ERR,"entry_add: tmp-meta: %s",strerror(errno));
+      return HTTP_ISERVERERR;
     }
+    
+    if (req->date == NULL)
+      snprintf(ts,sizeof(ts),"%04d/%02d/%02d",blog->now.year,blog->now.month,blog->now.day);
     else
+      snprintf(ts,sizeof(ts),"%s",req->date);
+      
+    fputs(req->body,fpbody);
+    fprintf(
+      fpmeta,
+      "Author: %s\n"
+      "Title: %s\n"
+      "Class: %s\n"
+      "Status: %s\n"
+      "Date: %s\n"
+      "Adtag: %s\n"
+      "\n",
+      req->author,
+      req->title,
+      req->class,
+      req->status,
+      ts,
+      req->adtag
+    );
+    
+    if ((fflush(fpbody) != 0) || (fflush(fpmeta) != 0))
     {
-      remove(fnbody);
-      syslog(LOG_ERR,"entry_add: tmp-meta: %s",strerror(errno));
+      syslog(LOG_ERR,"entry_add: prehook data: %s",strerror(errno));
+      fclose(fpmeta);
+      fclose(fpbody);
       return HTTP_ISERVERERR;
     }
     
-    rc = run_hook("entry-pre-hook",(char const *[]){ blog->config.prehook , fnbody , fnmeta , NULL });
-    
-    remove(fnmeta);
-    remove(fnbody);
+    rc = run_hook_fds(
+            "entry-pre-hook",
+            (char const *[]){ blog->config.prehook , fnbody , fnmeta , NULL },
+            (int const []){ fileno(fpbody) , fileno(fpmeta) },
+            2
+         );
+         
+    fclose(fpmeta);
+    fclose(fpbody);
     
     if (!rc)
       return HTTP_UNPROCESSENTITY;
@@ -114,7 +155,7 @@ http__e entry_add(Blog *blog,Request *req)
   entry = BlogEntryNew(blog);
   if (entry == NULL)
     return HTTP_ISERVERERR;
-  
+    
   if (emptynull_string(req->date))
     entry->when = blog->now;
   else
@@ -135,7 +176,7 @@ http__e entry_add(Blog *blog,Request *req)
   entry->adtag     = req->adtag;
   entry->body      = req->body;
   
-  if (BlogEntryWrite(entry) == 0)
+  if (BlogEntryWrite(entry,&req->oldclass) == 0)
   {
     req->when = entry->when;
     
@@ -162,7 +203,7 @@ http__e entry_add(Blog *blog,Request *req)
       argv[4] = req->status;
       argv[5] = NULL;
       
-      if (!run_hook("entry-post-hook",argv))
+      if (!queue_hook(blog->config.hookspool,"entry-post-hook",argv))
         status = HTTP_ACCEPTED;
       else
         status = HTTP_CREATED;
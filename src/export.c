@@ -0,0 +1,611 @@
+/************************************************************************
+*
+* Copyright 2026 by Sean Conner.  All Rights Reserved.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*
+* Comments, questions and criticisms can be sent to: sean@conman.org
+*
+*************************************************************************/
+
+
+/*************************************************************************
+*
+* Export the whole journal as one stream, either as JSON lines (an object
+* per entry, with its meta data and the contents of its sidecar files) or
+* as a tar file of the day directories (which can be unpacked into an empty
+* basedir as is).
+*
+* It's a single pass over the year, month and day directories, in order.
+* The files of a day are opened together, and the kernel told to start
+* reading them all in (POSIX_FADV_WILLNEED) before they're copied out in
+* turn, then to drop them (POSIX_FADV_DONTNEED), so a dump doesn't push
+* everything else out of the page cache.  The meta data files of a day are
+* read once for all of its entries, and everything else is copied through
+* a fixed buffer, so the memory used doesn't depend on the size of the
+* entries.
+*
+* No lock is held, so an entry added during an export may or may not be
+* in it.
+*
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <syslog.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "export.h"
+#include "conversion.h"
+
+#define EXPORT_BUFSIZE  (64uL * 1024uL)
+#define TAR_BLOCK       512
+
+struct dayfile
+{
+  char        name[NAME_MAX + 1];
+  int         fh;
+  struct stat status;
+};
+
+struct export
+{
+  FILE      *out;
+  export__e  format;
+  char       buffer[EXPORT_BUFSIZE];
+};
+
+static char const *const m_meta[] = { "titles" , "class" , "authors" , "status" , "adtag" };
+static char const *const m_keys[] = { "title"  , "class" , "author"  , "status" , "adtag" };
+
+#define METANUM (sizeof(m_meta) / sizeof(m_meta[0]))
+
+/*************************************************************************/
+
+static bool all_digits(char const *name)
+{
+  assert(name != NULL);
+  
+  if (*name == '\0')
+    return false;
+  for ( ; *name != '\0' ; name++)
+    if (!isdigit((unsigned char)*name))
+      return false;
+  return true;
+}
+
+/*************************************************************************/
+
+static int name_cmp(void const *left,void const *right)
+{
+  char const *const *l = left;
+  char const *const *r = right;
+  
+  return strcmp(*l,*r);
+}
+
+/*************************************************************************/
+
+static size_t dir_list(char const *path,size_t len,char ***pnames)
+{
+  DIR            *dir;
+  struct dirent  *ent;
+  char          **names = NULL;
+  size_t          num   = 0;
+  size_t          max   = 0;
+  
+  assert(path   != NULL);
+  assert(pnames != NULL);
+  
+  /*----------------------------------------------------------------------
+  ; With a length, only names of that many digits (years, months, days);
+  ; without, anything that isn't hidden (like an index being rebuilt).
+  ;-----------------------------------------------------------------------*/
+  
+  *pnames = NULL;
+  dir     = opendir(path);
+  if (dir == NULL)
+  {
+    syslog(LOG_ERR,"%s: %s",path,strerror(errno));
+    return 0;
+  }
+  
+  while((ent = readdir(dir)) != NULL)
+  {
+    if (len > 0)
+    {
+      if ((strlen(ent->d_name) != len) || !all_digits(ent->d_name))
+        continue;
+    }
+    else if (ent->d_name[0] == '.')
+      continue;
+      
+    if (num == max)
+    {
+      char **n = realloc(names,(max + 32) * sizeof(char *));
+      if (n == NULL)
+        break;
+      names = n;
+      max  += 32;
+    }
+    
+    names[num] = strdup(ent->d_name);
+    if (names[num] != NULL)
+      num++;
+  }
+  
+  closedir(dir);
+  if (num > 0)
+    qsort(names,num,sizeof(char *),name_cmp);
+  *pnames = names;
+  return num;
+}
+
+/*************************************************************************/
+
+static void dir_free(char **names,size_t num)
+{
+  for (size_t i = 0 ; i < num ; i++)
+    free(names[i]);
+  free(names);
+}
+
+/*************************************************************************/
+
+static void json_write(FILE *out,char const *text,size_t len)
+{
+  FILE *jout;
+  
+  assert(out  != NULL);
+  assert(text != NULL);
+  
+  jout = fjson_encode_onwrite(out);
+  if (jout == NULL)
+  {
+    syslog(LOG_ERR,"export: %s",strerror(errno));
+    return;
+  }
+  
+  fwrite(text,1,len,jout);
+  fclose(jout);
+}
+
+/*************************************************************************/
+
+static void json_file(struct export *ex,char const *key,struct dayfile *file)
+{
+  FILE    *jout;
+  ssize_t  bytes;
+  
+  assert(ex   != NULL);
+  assert(key  != NULL);
+  assert(file != NULL);
+  
+  fputs(",\"",ex->out);
+  json_write(ex->out,key,strlen(key));
+  fputs("\":\"",ex->out);
+  
+  /*---------------------------------------------------------------------
+  ; One encoder for the whole file, as a UTF-8 sequence can straddle two
+  ; reads.
+  ;----------------------------------------------------------------------*/
+  
+  jout = fjson_encode_onwrite(ex->out);
+  if (jout == NULL)
+    syslog(LOG_ERR,"export: %s",strerror(errno));
+  else
+  {
+    while((bytes = read(file->fh,ex->buffer,sizeof(ex->buffer))) > 0)
+      fwrite(ex->buffer,1,bytes,jout);
+    if (bytes == -1)
+      syslog(LOG_ERR,"%s: %s",file->name,strerror(errno));
+    fclose(jout);
+  }
+  putc('"',ex->out);
+}
+
+/*************************************************************************/
+
+static size_t meta_read(struct dayfile *file,char **ptext,char ***plines)
+{
+  char    *text;
+  char   **lines = NULL;
+  size_t   num   = 0;
+  ssize_t  bytes;
+  
+  assert(ptext  != NULL);
+  assert(plines != NULL);
+  
+  *ptext  = NULL;
+  *plines = NULL;
+  
+  if (file == NULL)
+    return 0;
+    
+  text = malloc(file->status.st_size + 1);
+  if (text == NULL)
+    return 0;
+    
+  bytes = read(file->fh,text,file->status.st_size);
+  if (bytes < 0)
+  {
+    syslog(LOG_ERR,"%s: %s",file->name,strerror(errno));
+    bytes = 0;
+  }
+  text[bytes] = '\0';
+  
+  for (char *p = text ; *p != '\0' ; )
+  {
+    char  *nl = strchr(p,'\n');
+    char **n  = realloc(lines,(num + 1) * sizeof(char *));
+    
+    if (n == NULL)
+      break;
+    lines        = n;
+    lines[num++] = p;
+    
+    if (nl == NULL)
+      break;
+    *nl = '\0';
+    p   = nl + 1;
+  }
+  
+  *ptext  = text;
+  *plines = lines;
+  return num;
+}
+
+/*************************************************************************/
+
+static struct dayfile *day_find(struct dayfile *files,size_t num,char const *name)
+{
+  assert(files != NULL);
+  assert(name  != NULL);
+  
+  for (size_t i = 0 ; i < num ; i++)
+    if ((files[i].fh != -1) && (strcmp(files[i].name,name) == 0))
+      return &files[i];
+  return NULL;
+}
+
+/*************************************************************************/
+
+static void json_day(struct export *ex,char const *path,struct dayfile *files,size_t num)
+{
+  char   *text [METANUM];
+  char  **lines[METANUM];
+  size_t  nums [METANUM];
+  int     maxpart = 0;
+  
+  assert(ex    != NULL);
+  assert(path  != NULL);
+  assert(files != NULL);
+  
+  for (size_t k = 0 ; k < METANUM ; k++)
+    nums[k] = meta_read(day_find(files,num,m_meta[k]),&text[k],&lines[k]);
+    
+  for (size_t i = 0 ; i < num ; i++)
+    if ((files[i].fh != -1) && all_digits(files[i].name) && (atoi(files[i].name) > maxpart))
+      maxpart = atoi(files[i].name);
+      
+  for (int part = 1 ; part <= maxpart ; part++)
+  {
+    struct dayfile *body;
+    char            name[32];
+    size_t          len;
+    
+    snprintf(name,sizeof(name),"%d",part);
+    body = day_find(files,num,name);
+    if (body == NULL)
+      continue;
+      
+    fprintf(ex->out,"{\"id\":\"%s.%d\"",path,part);
+    
+    for (size_t k = 0 ; k < METANUM ; k++)
+    {
+      char const *value = (size_t)part <= nums[k] ? lines[k][part - 1] : "";
+      
+      fprintf(ex->out,",\"%s\":\"",m_keys[k]);
+      json_write(ex->out,value,strlen(value));
+      putc('"',ex->out);
+    }
+    
+    fprintf(ex->out,",\"timestamp\":%lld",(long long)body->status.st_mtime);
+    json_file(ex,"body",body);
+    
+    /*--------------------------------------------------------------------
+    ; Sidecar files (N.comments, N.webmention and the like) go in under the
+    ; name after the dot.
+    ;---------------------------------------------------------------------*/
+    
+    len = strlen(name);
+    for (size_t i = 0 ; i < num ; i++)
+    {
+      if (
+              (files[i].fh != -1)
+           && (strncmp(files[i].name,name,len) == 0)
+           && (files[i].name[len]     == '.')
+           && (files[i].name[len + 1] != '\0')
+         )
+        json_file(ex,&files[i].name[len + 1],&files[i]);
+    }
+    
+    fputs("}\n",ex->out);
+  }
+  
+  for (size_t k = 0 ; k < METANUM ; k++)
+  {
+    free(lines[k]);
+    free(text[k]);
+  }
+}
+
+/*************************************************************************/
+
+static void tar_file(struct export *ex,char const *dir,struct dayfile *file)
+{
+  unsigned char header[TAR_BLOCK];
+  unsigned long sum;
+  off_t         size;
+  off_t         copied;
+  ssize_t       bytes;
+  
+  assert(ex   != NULL);
+  assert(dir  != NULL);
+  assert(file != NULL);
+  
+  /*----------------------------------------------------------------------
+  ; A POSIX (ustar) header.  The directory goes in the prefix field, which
+  ; leaves the full hundred bytes for the name of the file.
+  ;-----------------------------------------------------------------------*/
+  
+  if ((strlen(file->name) > 100) || (strlen(dir) > 155))
+  {
+    syslog(LOG_ERR,"%s/%s: name too long for tar",dir,file->name);
+    return;
+  }
+  
+  size = file->status.st_size;
+  memset(header,0,sizeof(header));
+  memcpy(&header[0],file->name,strlen(file->name));
+  snprintf((char *)&header[100],8,"%07o",(unsigned int)(file->status.st_mode & 07777));
+  snprintf((char *)&header[108],8,"%07o",0u);
+  snprintf((char *)&header[116],8,"%07o",0u);
+  snprintf((char *)&header[124],12,"%011llo",(unsigned long long)size);
+  snprintf((char *)&header[136],12,"%011llo",(unsigned long long)file->status.st_mtime);
+  memset(&header[148],' ',8);
+  header[156] = '0';
+  memcpy(&header[257],"ustar",6);
+  memcpy(&header[263],"00",2);
+  memcpy(&header[345],dir,strlen(dir));
+  
+  sum = 0;
+  for (size_t i = 0 ; i < sizeof(header) ; i++)
+    sum += header[i];
+  snprintf((char *)&header[148],7,"%06lo",sum);
+  
+  fwrite(header,1,sizeof(header),ex->out);
+  
+  /*----------------------------------------------------------------------
+  ; The header gave the size, so exactly that much goes out, even if the
+  ; file changed in the meantime (a new comment, say).
+  ;-----------------------------------------------------------------------*/
+  
+  for (copied = 0 ; copied < size ; copied += bytes)
+  {
+    size_t want = size - copied < (off_t)sizeof(ex->buffer) ? (size_t)(size - copied) : sizeof(ex->buffer);
+    
+    bytes = read(file->fh,ex->buffer,want);
+    if (bytes <= 0)
+    {
+      if (bytes == -1)
+        syslog(LOG_ERR,"%s/%s: %s",dir,file->name,strerror(errno));
+      memset(ex->buffer,0,want);
+      bytes = want;
+    }
+    fwrite(ex->buffer,1,bytes,ex->out);
+  }
+  
+  if (size % TAR_BLOCK != 0)
+  {
+    memset(ex->buffer,0,TAR_BLOCK);
+    fwrite(ex->buffer,1,TAR_BLOCK - size % TAR_BLOCK,ex->out);
+  }
+}
+
+/*************************************************************************/
+
+static bool file_open(char const *dir,char const *name,struct dayfile *file)
+{
+  char path[FILENAME_MAX];
+  
+  assert(dir  != NULL);
+  assert(name != NULL);
+  assert(file != NULL);
+  
+  snprintf(file->name,sizeof(file->name),"%s",name);
+  snprintf(path,sizeof(path),"%s/%s",dir,name);
+  
+  file->fh = open(path,O_RDONLY);
+  if (file->fh == -1)
+  {
+    syslog(LOG_ERR,"%s: %s",path,strerror(errno));
+    return false;
+  }
+  
+  if ((fstat(file->fh,&file->status) == -1) || !S_ISREG(file->status.st_mode))
+  {
+    close(file->fh);
+    file->fh = -1;
+    return false;
+  }
+  
+  posix_fadvise(file->fh,0,0,POSIX_FADV_WILLNEED);
+  return true;
+}
+
+/*************************************************************************/
+
+static void file_close(struct dayfile *file)
+{
+  assert(file != NULL);
+  
+  if (file->fh != -1)
+  {
+    posix_fadvise(file->fh,0,0,POSIX_FADV_DONTNEED);
+    close(file->fh);
+    file->fh = -1;
+  }
+}
+
+/*************************************************************************/
+
+static void export_day(struct export *ex,char const *path)
+{
+  struct dayfile  *files;
+  char           **names;
+  size_t           num;
+  
+  assert(ex   != NULL);
+  assert(path != NULL);
+  
+  num = dir_list(path,0,&names);
+  if (num == 0)
+  {
+    free(names);
+    return;
+  }
+  
+  files = malloc(num * sizeof(struct dayfile));
+  if (files == NULL)
+  {
+    syslog(LOG_ERR,"%s: %s",path,strerror(ENOMEM));
+    dir_free(names,num);
+    return;
+  }
+  
+  for (size_t i = 0 ; i < num ; i++)
+    file_open(path,names[i],&files[i]);
+    
+  if (ex->format == EXPORT_TAR)
+  {
+    for (size_t i = 0 ; i < num ; i++)
+      if (files[i].fh != -1)
+        tar_file(ex,path,&files[i]);
+  }
+  else
+    json_day(ex,path,files,num);
+    
+  for (size_t i = 0 ; i < num ; i++)
+    file_close(&files[i]);
+    
+  free(files);
+  dir_free(names,num);
+}
+
+/*************************************************************************/
+
+bool export_archive(Blog *blog,FILE *out,export__e format)
+{
+  struct export  *ex;
+  char          **years;
+  size_t          numy;
+  bool            okay;
+  
+  assert(blog != NULL);
+  assert(out  != NULL);
+  
+  ex = malloc(sizeof(struct export));
+  if (ex == NULL)
+    return false;
+    
+  ex->out    = out;
+  ex->format = format;
+  setvbuf(out,NULL,_IOFBF,EXPORT_BUFSIZE);
+  
+  /*----------------------------------------------------------------------
+  ; A tar file gets the markers of the first and last entries as well, so
+  ; what's unpacked is a working journal.
+  ;-----------------------------------------------------------------------*/
+  
+  if (format == EXPORT_TAR)
+  {
+    static char const *const markers[] = { ".first" , ".last" };
+    
+    for (size_t i = 0 ; i < sizeof(markers) / sizeof(markers[0]) ; i++)
+    {
+      struct dayfile file;
+      
+      if (file_open(".",markers[i],&file))
+      {
+        tar_file(ex,"",&file);
+        file_close(&file);
+      }
+    }
+  }
+  
+  numy = dir_list(".",4,&years);
+  for (size_t y = 0 ; y < numy ; y++)
+  {
+    char   **months;
+    size_t   numm = dir_list(years[y],2,&months);
+    
+    for (size_t m = 0 ; m < numm ; m++)
+    {
+      char     path[FILENAME_MAX];
+      char   **days;
+      size_t   numd;
+      
+      snprintf(path,sizeof(path),"%s/%s",years[y],months[m]);
+      numd = dir_list(path,2,&days);
+      
+      for (size_t d = 0 ; d < numd ; d++)
+      {
+        snprintf(path,sizeof(path),"%s/%s/%s",years[y],months[m],days[d]);
+        export_day(ex,path);
+      }
+      
+      dir_free(days,numd);
+    }
+    
+    dir_free(months,numm);
+  }
+  
+  dir_free(years,numy);
+  
+  if (format == EXPORT_TAR)
+  {
+    memset(ex->buffer,0,TAR_BLOCK * 2);
+    fwrite(ex->buffer,1,TAR_BLOCK * 2,out);
+  }
+  
+  okay = (fflush(out) == 0) && !ferror(out);
+  if (!okay)
+    syslog(LOG_ERR,"export: %s",strerror(errno));
+  free(ex);
+  return okay;
+}
+
+/*************************************************************************/
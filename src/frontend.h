@@ -35,11 +35,12 @@ typedef struct request
   char        *author;
   char        *title;
   char        *class;
+  char        *oldclass;    /* tags an edited entry had before */
   char        *status;
   char        *date;
   char        *adtag;
   char        *origbody;
-  char        *body;
+  char        *body;        /* may be the same as origbody */
   char const  *reqtumbler;
   struct btm   when;
   tumbler__s   tumbler;
@@ -57,6 +58,12 @@ typedef struct request
     unsigned int regenerate : 1;
     unsigned int today      : 1;
     unsigned int thisday    : 1;
+    unsigned int overview   : 1;
+    unsigned int search     : 1;
+    unsigned int reindex    : 1;
+    unsigned int class      : 1;
+    unsigned int runhooks   : 1;
+    unsigned int export     : 1;
   } f;
 } Request;
 
@@ -20,21 +20,48 @@
 *
 *************************************************************************/
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <cgilib8/crashreport.h>
+#include "stats.h"
 #include "main.h"
 
 /************************************************************************/
 
 int main(int argc,char *argv[])
 {
+  char label[256];
+  int  rc;
+  
   crashreport_args(argc,argv,true);
   crashreport_core();
   
   if (getenv("GATEWAY_INTERFACE") == NULL)
-    return main_cli(argc,argv);
+  {
+    size_t len = 0;
+    
+    label[0] = '\0';
+    for (int i = 1 ; (i < argc) && (len < sizeof(label)) ; i++)
+      len += snprintf(&label[len],sizeof(label) - len,"%s%s",i > 1 ? " " : "",argv[i]);
+      
+    stats_init(label);
+    rc = main_cli(argc,argv);
+  }
   else
-    return main_cgi();
+  {
+    char const *method = getenv("REQUEST_METHOD");
+    char const *uri    = getenv("REQUEST_URI");
+    
+    snprintf(label,sizeof(label),"%s %s",method ? method : "-",uri ? uri : "-");
+    stats_init(label);
+    rc = main_cgi();
+  }
+  
+  stats_start(STAGE_OUTPUT);
+  fflush(stdout);
+  stats_stop(STAGE_OUTPUT);
+  stats_report();
+  return rc;
 }
 
 /***********************************************************************/
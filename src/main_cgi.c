@@ -28,6 +28,8 @@
 #include <cgilib8/util.h>
 
 #include "backend.h"
+#include "throttle.h"
+#include "stats.h"
 #include "main.h"
 
 typedef int (*cgicmd__f)(Cgi,Blog *,struct request *);
@@ -143,6 +145,82 @@ static void redirect(http__e status,char const *base,char const *path)
 
 /**********************************************************************/
 
+static void overloaded(int status,unsigned int retry)
+{
+  assert((status == 429) || (status == 503));
+  
+  /*-----------------------------------------------------------------------
+  ; This is sent before the blog is even loaded, so keep it simple, and
+  ; cheap.
+  ;------------------------------------------------------------------------*/
+  
+  printf(
+    "Status: %d\r\n"
+    "Retry-After: %u\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Length: 11\r\n"
+    "\r\n"
+    "Slow down.\n",
+    status,
+    retry
+  );
+}
+
+/**********************************************************************/
+
+static throttle__e throttle_request(Cgi cgi,unsigned int *retry)
+{
+  static char const *const commands[] =
+  {
+    "new",
+    "show",
+    "preview",
+    "today",
+    "last",
+    "overview",
+    "search",
+    "class",
+  };
+  
+  char const *cmd   = CgiGetQValue(cgi,"cmd");
+  char const *path  = getenv("PATH_INFO");
+  char const *which = "other";
+  char        route[64];
+  
+  assert(cgi   != NULL);
+  assert(retry != NULL);
+  
+  /*-----------------------------------------------------------------------
+  ; The route is one of the commands we know about, so a client can't make
+  ; up routes to fill the table with.  Ranges are far more expensive than
+  ; anything else we serve up, so count them as a route of their own.
+  ;------------------------------------------------------------------------*/
+  
+  if (emptynull_string(cmd))
+    which = "show";
+  else
+  {
+    for (size_t i = 0 ; i < sizeof(commands) / sizeof(commands[0]) ; i++)
+      if (strcmp(cmd,commands[i]) == 0)
+      {
+        which = commands[i];
+        break;
+      }
+  }
+  
+  snprintf(
+    route,
+    sizeof(route),
+    "GET %s%s",
+    which,
+    (path != NULL) && (strchr(path,'-') != NULL) ? " range" : ""
+  );
+  
+  return throttle_check(getenv("REMOTE_ADDR"),route,retry);
+}
+
+/**********************************************************************/
+
 static int cmd_cgi_error(Cgi cgi,Blog *blog,Request *request)
 {
   (void)cgi;
@@ -190,8 +268,14 @@ static int cmd_cgi_get_show(Cgi cgi,Blog *blog,Request *req)
   }
   else
   {
+    bool okay;
+    
     req->reqtumbler++;
-    if (tumbler_new(&req->tumbler,req->reqtumbler,&blog->first,&blog->last))
+    stats_start(STAGE_TUMBLER);
+    okay = tumbler_new(&req->tumbler,req->reqtumbler,&blog->first,&blog->last);
+    stats_stop(STAGE_TUMBLER);
+    
+    if (okay)
     {
       if (req->tumbler.redirect)
       {
@@ -248,7 +332,11 @@ static int cmd_cgi_get_today(Cgi cgi,Blog *blog,Request *req)
     return 0;
   }
   
-  if (!thisday_new(&req->tumbler,twhen))
+  stats_start(STAGE_TUMBLER);
+  bool okay = thisday_new(&req->tumbler,twhen);
+  stats_stop(STAGE_TUMBLER);
+  
+  if (!okay)
     return cgi_error(blog,req,HTTP_BADREQ,"bad request");
     
   if (req->tumbler.redirect)
@@ -269,6 +357,52 @@ static int cmd_cgi_get_today(Cgi cgi,Blog *blog,Request *req)
 
 /**********************************************************************/
 
+static int cmd_cgi_get_overview(Cgi cgi,Blog *blog,Request *req)
+{
+  char *date;
+  
+  assert(cgi  != NULL);
+  assert(blog != NULL);
+  assert(req  != NULL);
+  
+  date = CgiGetQValue(cgi,"date");
+  return generate_overview(blog,req,emptynull_string(date) ? NULL : date,cgi_error);
+}
+
+/**********************************************************************/
+
+static int cmd_cgi_get_search(Cgi cgi,Blog *blog,Request *req)
+{
+  char *query;
+  
+  assert(cgi  != NULL);
+  assert(blog != NULL);
+  assert(req  != NULL);
+  
+  query = CgiGetQValue(cgi,"q");
+  if (emptynull_string(query))
+    return cgi_error(blog,req,HTTP_BADREQ,"no query");
+  return generate_search(blog,req,query,cgi_error);
+}
+
+/**********************************************************************/
+
+static int cmd_cgi_get_class(Cgi cgi,Blog *blog,Request *req)
+{
+  char *class;
+  
+  assert(cgi  != NULL);
+  assert(blog != NULL);
+  assert(req  != NULL);
+  
+  class = CgiGetQValue(cgi,"class");
+  if (emptynull_string(class))
+    return cgi_error(blog,req,HTTP_BADREQ,"no class");
+  return generate_class(blog,req,class,cgi_error);
+}
+
+/**********************************************************************/
+
 static int cmd_cgi_get_last(Cgi cgi,Blog *blog,Request *req)
 {
   char buf[BUFSIZ];
@@ -352,6 +486,12 @@ static cgicmd__f set_m_cgi_get_command(char const *value)
     return cmd_cgi_get_today;
   else if (strcmp(value,"last") == 0)
     return cmd_cgi_get_last;
+  else if (strcmp(value,"overview") == 0)
+    return cmd_cgi_get_overview;
+  else if (strcmp(value,"search") == 0)
+    return cmd_cgi_get_search;
+  else if (strcmp(value,"class") == 0)
+    return cmd_cgi_get_class;
   else
     return cmd_cgi_error;
 }
@@ -479,7 +619,7 @@ static void main_cgi_POST(Cgi cgi,Blog *blog,Request *request)
   request->date     = safe_strdup(CgiGetValue(cgi,"date"));
   request->adtag    = safe_strdup(CgiGetValue(cgi,"adtag"));
   request->origbody = safe_strdup(CgiGetValue(cgi,"body"));
-  request->body     = safe_strdup(request->origbody);
+  request->body     = request->origbody;
   
   (*set_m_cgi_post_command(CgiGetValue(cgi,"cmd")))(cgi,blog,request);
 }
@@ -558,8 +698,24 @@ int main_cgi(void)
     cgi_error(NULL,NULL,HTTP_ISERVERERR,"");
   else
   {
+    unsigned int retry;
+    throttle__e  throttle = THROTTLE_OKAY;
+    
+    /*----------------------------------------------------------------------
+    ; Only GET and HEAD are throttled---everything else requires an author
+    ; to log in.  And check before loading the blog, as that's where the
+    ; expense starts.
+    ;-----------------------------------------------------------------------*/
+    
+    if ((CgiMethod(cgi) == GET) || (CgiMethod(cgi) == HEAD))
+      throttle = throttle_request(cgi,&retry);
+      
     if (CgiStatus(cgi) != HTTP_OKAY)
       cgi_error(NULL,NULL,CgiStatus(cgi),"processing error");
+    else if (throttle == THROTTLE_CLIENT)
+      overloaded(429,retry);
+    else if (throttle == THROTTLE_ROUTE)
+      overloaded(503,retry);
     else
     {
       Blog *blog = BlogNew(NULL);
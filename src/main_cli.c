@@ -35,6 +35,10 @@
 #include "backend.h"
 #include "frontend.h"
 #include "blogutil.h"
+#include "throttle.h"
+#include "stats.h"
+#include "search.h"
+#include "export.h"
 #include "main.h"
 
 typedef int (*clicmd__f)(Blog *,Request *);
@@ -66,7 +70,7 @@ int mailfile_readdata(Blog *blog,Request *req)
   fcopy(output,stdin);
   fclose(output);
   
-  req->body = strdup(req->origbody);
+  req->body = req->origbody;
   return 0;
 }
 
@@ -180,6 +184,216 @@ static int cmd_cli_new(Blog *blog,Request *req)
     return cli_error(blog,req,status,"Failed to create new entry");
 }
 
+/****************************************************************************
+*
+* Import a stream of entries, each in the format read by mailfile_readdata(),
+* as an mbox file---each entry starts with a "From " line, and lines of the
+* body starting with "From " (after any number of '>') are quoted with a
+* '>' (the "mboxrd" format).  A stream without a "From " line is a single
+* entry.  The entries are written in one batch, and the pages regenerated
+* once at the end.
+*
+* This writes straight into the blog, as the owner of it---there's no
+* author check and the prehook and posthook aren't run.
+*
+*****************************************************************************/
+
+static BlogEntry *import_entry(Blog *blog,char *text,size_t size)
+{
+  FILE       *in;
+  List        headers;
+  BlogEntry  *entry;
+  char const *date;
+  long        body;
+  
+  assert(blog != NULL);
+  assert(text != NULL);
+  
+  if (size == 0)
+    return NULL;
+    
+  in = fmemopen(text,size,"r");
+  if (in == NULL)
+    return NULL;
+    
+  ListInit(&headers);
+  RFC822HeadersRead(in,&headers);
+  body = ftell(in);
+  fclose(in);
+  
+  entry = BlogEntryNew(blog);
+  if (entry == NULL)
+  {
+    PairListFree(&headers);
+    return NULL;
+  }
+  
+  entry->author = safe_strdup(PairListGetValue(&headers,"AUTHOR"));
+  entry->title  = safe_strdup(PairListGetValue(&headers,"TITLE"));
+  entry->class  = safe_strdup(PairListGetValue(&headers,"CLASS"));
+  entry->status = safe_strdup(PairListGetValue(&headers,"STATUS"));
+  entry->adtag  = safe_strdup(PairListGetValue(&headers,"ADTAG"));
+  date          = PairListGetValue(&headers,"DATE");
+  
+  if (!emptynull_string(date))
+  {
+    if (
+            (sscanf(date,"%d/%d/%d",&entry->when.year,&entry->when.month,&entry->when.day) != 3)
+         || (entry->when.month < 1) || (entry->when.month > 12)
+         || (entry->when.day   < 1) || (entry->when.day   > 31)
+       )
+    {
+      fprintf(stderr,"import: bad date '%s' for '%s'\n",date,entry->title);
+      PairListFree(&headers);
+      BlogEntryFree(entry);
+      return NULL;
+    }
+  }
+  
+  PairListFree(&headers);
+  
+  if (emptynull_string(entry->author))
+  {
+    free(entry->author);
+    entry->author = strdup(blog->config.author.name);
+  }
+  
+  /*----------------------------------------------------------------------
+  ; The body is what's left after the headers, so it's moved down in place
+  ; to become the body of the entry.  The blank line separating it from the
+  ; next entry in the mbox isn't part of it.
+  ;-----------------------------------------------------------------------*/
+  
+  if ((body < 0) || ((size_t)body > size))
+    body = size;
+  size -= body;
+  memmove(text,&text[body],size + 1);
+  if ((size >= 2) && (text[size - 1] == '\n') && (text[size - 2] == '\n'))
+    text[size - 1] = '\0';
+  entry->body = text;
+  return entry;
+}
+
+/****************************************************************************/
+
+static int cmd_cli_import(Blog *blog,Request *req)
+{
+  BlogEntry **entries = NULL;
+  size_t      num     = 0;
+  size_t      max     = 0;
+  char       *line    = NULL;
+  size_t      lsize   = 0;
+  char       *text    = NULL;
+  size_t      size    = 0;
+  FILE       *msg     = NULL;
+  bool        okay    = true;
+  ssize_t     bytes;
+  int         rc;
+  
+  assert(blog != NULL);
+  assert(req  != NULL);
+  
+  while(okay)
+  {
+    bytes = getline(&line,&lsize,stdin);
+    
+    if ((bytes == -1) || (strncmp(line,"From ",5) == 0))
+    {
+      if (msg != NULL)
+      {
+        BlogEntry *entry;
+        
+        fclose(msg);
+        msg   = NULL;
+        entry = import_entry(blog,text,size);
+        
+        if (entry == NULL)
+        {
+          free(text);
+          okay = false;
+        }
+        else
+        {
+          if (num == max)
+          {
+            BlogEntry **n = realloc(entries,(max + 256) * sizeof(BlogEntry *));
+            if (n == NULL)
+            {
+              BlogEntryFree(entry);
+              okay = false;
+              break;
+            }
+            entries = n;
+            max    += 256;
+          }
+          entries[num++] = entry;
+        }
+        
+        text = NULL;
+      }
+      
+      if (bytes == -1)
+        break;
+        
+      msg = open_memstream(&text,&size);
+      if (msg == NULL)
+        okay = false;
+      continue;
+    }
+    
+    if (msg == NULL)
+    {
+      msg = open_memstream(&text,&size);
+      if (msg == NULL)
+      {
+        okay = false;
+        break;
+      }
+    }
+    
+    char const *p = line;
+    
+    if (*p == '>')
+    {
+      char const *q = p;
+      while(*q == '>')
+        q++;
+      if (strncmp(q,"From ",5) == 0)
+        p++;
+    }
+    
+    fwrite(p,1,bytes - (p - line),msg);
+  }
+  
+  if (msg != NULL)
+  {
+    fclose(msg);
+    free(text);
+  }
+  free(line);
+  
+  /*----------------------------------------------------------------------
+  ; Nothing is written unless the whole stream could be read.
+  ;-----------------------------------------------------------------------*/
+  
+  if (!okay)
+    rc = cli_error(blog,req,HTTP_BADREQ,"import: entry %zu not imported, nothing written",num + 1);
+  else if ((rc = BlogEntryWriteBatch(blog,entries,num)) != 0)
+    rc = cli_error(blog,req,HTTP_ISERVERERR,"import: %s",strerror(rc));
+  else
+  {
+    req->f.regenerate = true;
+    generate_pages(blog,req);
+    printf("%zu entries imported\n",num);
+    rc = 0;
+  }
+  
+  for (size_t i = 0 ; i < num ; i++)
+    BlogEntryFree(entries[i]);
+  free(entries);
+  return rc;
+}
+
 /****************************************************************************/
 
 static int cmd_cli_show(Blog *blog,Request *req)
@@ -193,9 +407,44 @@ static int cmd_cli_show(Blog *blog,Request *req)
     rc = generate_pages(blog,req);
   else if (req->f.today)
     rc = generate_thisday(blog,req,stdout,blog->now);
+  else if (req->f.overview)
+    rc = generate_overview(blog,req,req->reqtumbler,cli_error);
+  else if (req->f.search)
+    rc = generate_search(blog,req,req->reqtumbler,cli_error);
+  else if (req->f.class)
+    rc = generate_class(blog,req,req->reqtumbler,cli_error);
+  else if (req->f.reindex)
+    rc = search_build(blog) ? 0 : cli_error(blog,req,HTTP_ISERVERERR,"cannot build the search index");
+  else if (req->f.runhooks)
+  {
+    if (blog->config.hookspool == NULL)
+      rc = cli_error(blog,req,HTTP_BADREQ,"no hookspool configured");
+    else if ((req->reqtumbler != NULL) && (strcmp(req->reqtumbler,"once") != 0))
+      rc = cli_error(blog,req,HTTP_BADREQ,"--run-hooks takes only 'once'");
+    else
+      rc = run_hooks(
+                      blog->config.hookspool,
+                      blog->config.hookjobs,
+                      blog->config.hookretries,
+                      req->reqtumbler != NULL
+                    );
+  }
+  else if (req->f.export)
+  {
+    if ((req->reqtumbler == NULL) || (strcmp(req->reqtumbler,"json") == 0))
+      rc = export_archive(blog,stdout,EXPORT_JSON) ? 0 : cli_error(blog,req,HTTP_ISERVERERR,"export failed");
+    else if (strcmp(req->reqtumbler,"tar") == 0)
+      rc = export_archive(blog,stdout,EXPORT_TAR) ? 0 : cli_error(blog,req,HTTP_ISERVERERR,"export failed");
+    else
+      rc = cli_error(blog,req,HTTP_BADREQ,"--export takes 'json' or 'tar'");
+  }
   else if (req->f.thisday)
   {
-    if (!thisday_new(&req->tumbler,req->reqtumbler))
+    stats_start(STAGE_TUMBLER);
+    bool okay = thisday_new(&req->tumbler,req->reqtumbler);
+    stats_stop(STAGE_TUMBLER);
+    
+    if (!okay)
       rc = cli_error(blog,req,HTTP_BADREQ,"bad request");
     else if (req->tumbler.redirect)
       rc = cli_error(blog,req,HTTP_MOVEPERM,"Redirect: %02d/%02d",req->tumbler.start.month,req->tumbler.start.day);
@@ -211,6 +460,7 @@ static int cmd_cli_show(Blog *blog,Request *req)
       template.template = blog->config.templates[0].template;
       template.items    = blog->config.templates[0].items;
       template.pagegen  = "days";
+      template.class    = NULL;
       template.reverse  = true;
       template.fullurl  = false;
       
@@ -218,7 +468,11 @@ static int cmd_cli_show(Blog *blog,Request *req)
     }
     else
     {
-      if (tumbler_new(&req->tumbler,req->reqtumbler,&blog->first,&blog->last))
+      stats_start(STAGE_TUMBLER);
+      bool okay = tumbler_new(&req->tumbler,req->reqtumbler,&blog->first,&blog->last);
+      stats_stop(STAGE_TUMBLER);
+      
+      if (okay)
       {
         if (req->tumbler.redirect)
         {
@@ -251,6 +505,8 @@ static clicmd__f get_cli_command(char const *value)
     return cmd_cli_show;
   else if (strcmp(value,"preview") == 0)
     return cmd_cli_show;
+  else if (strcmp(value,"import") == 0)
+    return cmd_cli_import;
   else
     return cmd_cli_error;
 }
@@ -270,6 +526,14 @@ int main_cli(int argc,char *argv[])
     OPT_REGENERATE,
     OPT_TODAY,
     OPT_THISDAY,
+    OPT_OVERVIEW,
+    OPT_SEARCH,
+    OPT_REINDEX,
+    OPT_CLASS,
+    OPT_RUNHOOKS,
+    OPT_EXPORT,
+    OPT_THROTTLE,
+    OPT_STATS,
     OPT_HELP,
   };
   
@@ -284,6 +548,14 @@ int main_cli(int argc,char *argv[])
     { "entry"      , required_argument , NULL , OPT_ENTRY      } ,
     { "today"      , no_argument       , NULL , OPT_TODAY      } ,
     { "thisday"    , required_argument , NULL , OPT_THISDAY    } ,
+    { "overview"   , optional_argument , NULL , OPT_OVERVIEW   } ,
+    { "search"     , required_argument , NULL , OPT_SEARCH     } ,
+    { "reindex"    , no_argument       , NULL , OPT_REINDEX    } ,
+    { "class"      , required_argument , NULL , OPT_CLASS      } ,
+    { "run-hooks"  , optional_argument , NULL , OPT_RUNHOOKS   } ,
+    { "export"     , optional_argument , NULL , OPT_EXPORT     } ,
+    { "throttle"   , no_argument       , NULL , OPT_THROTTLE   } ,
+    { "stats"      , no_argument       , NULL , OPT_STATS      } ,
     { "help"       , no_argument       , NULL , OPT_HELP       } ,
     { NULL         , 0                 , NULL , 0               }
   };
@@ -328,9 +600,37 @@ int main_cli(int argc,char *argv[])
            request.f.thisday  = true;
            request.reqtumbler = optarg;
            break;
+      case OPT_OVERVIEW:
+           request.f.overview = true;
+           request.reqtumbler = optarg;
+           break;
+      case OPT_SEARCH:
+           request.f.search   = true;
+           request.reqtumbler = optarg;
+           break;
+      case OPT_REINDEX:
+           request.f.reindex  = true;
+           break;
+      case OPT_CLASS:
+           request.f.class    = true;
+           request.reqtumbler = optarg;
+           break;
+      case OPT_RUNHOOKS:
+           request.f.runhooks = true;
+           request.reqtumbler = optarg;
+           break;
+      case OPT_EXPORT:
+           request.f.export   = true;
+           request.reqtumbler = optarg;
+           break;
       case OPT_CMD:
            command = get_cli_command(optarg);
            break;
+      case OPT_THROTTLE:
+           return throttle_dump(stdout);
+      case OPT_STATS:
+           stats_summary();
+           break;
       case OPT_HELP:
       default:
            fprintf(
@@ -338,12 +638,20 @@ int main_cli(int argc,char *argv[])
                 "usage: %s --options... \n"
                 "\t--config file\n"
                 "\t--regenerate | --regen\n"
-                "\t--cmd ('new' | 'show' * | 'preview')\n"
+                "\t--cmd ('new' | 'show' * | 'preview' | 'import')\n"
                 "\t--file file\n"
                 "\t--email\n"
                 "\t--entry <tumbler>\n"
                 "\t--today\n"
                 "\t--thisday <month>/<day>\n"
+                "\t--overview[=<year>[/<month>]]\n"
+                "\t--search <words>\n"
+                "\t--reindex\n"
+                "\t--class <tag>\n"
+                "\t--run-hooks[=once]\n"
+                "\t--export[=json|tar]\n"
+                "\t--throttle\n"
+                "\t--stats\n"
                 "\t--help\n"
                 "\n"
                 "\tVersion: mod_blog " PROG_VERSION "\n"
@@ -44,6 +44,7 @@ Request *request_init(Request *request)
   request->author     = NULL;
   request->title      = NULL;
   request->class      = NULL;
+  request->oldclass   = NULL;
   request->status     = NULL;
   request->date       = NULL;
   request->adtag      = NULL;
@@ -63,11 +64,20 @@ void request_free(Request *request)
   free(request->author);
   free(request->title);
   free(request->class);
+  free(request->oldclass);
   free(request->status);
   free(request->date);
   free(request->adtag);
+  
+  /*----------------------------------------------------------------------
+  ; The body starts out shared with the original (which is kept for
+  ; editing), so a large post isn't held in memory twice.  Anything that
+  ; changes the body has to copy it first.
+  ;-----------------------------------------------------------------------*/
+  
+  if (request->body != request->origbody)
+    free(request->body);
   free(request->origbody);
-  free(request->body);
 }
 
 /************************************************************************/
@@ -20,77 +20,680 @@
 *
 ************************************************/
 
+/*************************************************************************
+*
+* Hooks other than the prehook (which decides if an entry is accepted) can
+* be queued to a spool directory (the "hookspool" configuration option) and
+* run later by a separate worker (--run-hooks), so a post isn't held up by
+* the posthook sending email or pinging other sites, and regenerating pages
+* isn't held up by the template posthooks.  Without a spool, hooks are run
+* as before, and waited for.
+*
+* A job is a file holding the tag and the arguments, each terminated by a
+* NUL byte.  It's written under a dot name (which the worker ignores),
+* synced, then renamed into place as
+*
+*       <seconds>.<nanoseconds>.<pid>.<attempts>
+*
+* where the time is when the job may next be run.  Names sort by time, so
+* jobs are run (mostly) in the order they were queued.  A failed job is
+* renamed with a later time (30 seconds, doubling per attempt, up to an
+* hour) and once it runs out of attempts, to <name>.failed for a human to
+* look at (a job that can't be made sense of goes there straight away).
+* Renames are atomic, so a job is never lost, although one that was
+* running when the worker was killed will be run again.  Only one worker
+* per spool runs at a time.
+*
+*************************************************************************/
+
+#include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <signal.h>
+#include <time.h>
 #include <assert.h>
 
+#include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/file.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <dirent.h>
 #include <syslog.h>
-#include <sysexits.h>
+#include <spawn.h>
+
+#include "backend.h"
+#include "stats.h"
+
+#define JOB_ARGS        16
+#define JOB_BACKOFF     30
+#define JOB_BACKOFF_MAX 3600
+
+struct job
+{
+  pid_t        pid;
+  char         name[64];
+  char         tag[64];
+  char         program[FILENAME_MAX];
+  bool         bad;
+};
+
+static volatile sig_atomic_t m_stop;
 
 /************************************************************************/
 
-bool run_hook(char const *tag,char const *argv[])
+static bool hook_keep(int fh,int const keep[],size_t num)
+{
+  for (size_t i = 0 ; i < num ; i++)
+    if (keep[i] == fh)
+      return true;
+  return false;
+}
+
+/************************************************************************/
+
+static bool hook_closes(posix_spawn_file_actions_t *actions,int const keep[],size_t num)
+{
+  int top = STDERR_FILENO;
+  
+  assert(actions != NULL);
+  
+  for (size_t i = 0 ; i < num ; i++)
+    if (keep[i] > top)
+      top = keep[i];
+      
+  /*----------------------------------------------------------------------
+  ; Below the highest descriptor kept, close those open and not kept; above
+  ; it, close everything in one go (which is close_range() on Linux).
+  ;-----------------------------------------------------------------------*/
+  
+  for (int fh = STDERR_FILENO + 1 ; fh < top ; fh++)
+    if (!hook_keep(fh,keep,num) && (fcntl(fh,F_GETFD) != -1))
+      if (posix_spawn_file_actions_addclose(actions,fh) != 0)
+        return false;
+        
+#if defined(__GLIBC__) && ((__GLIBC__ > 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ >= 34)))
+  return posix_spawn_file_actions_addclosefrom_np(actions,top + 1) == 0;
+#else
+  DIR           *dir = opendir("/proc/self/fd");
+  struct dirent *ent;
+  bool           okay = true;
+  
+  if (dir == NULL)
+  {
+    long max = sysconf(_SC_OPEN_MAX);
+    
+    for (int fh = top + 1 ; okay && (fh < max) ; fh++)
+      if (fcntl(fh,F_GETFD) != -1)
+        okay = posix_spawn_file_actions_addclose(actions,fh) == 0;
+    return okay;
+  }
+  
+  while(okay && ((ent = readdir(dir)) != NULL))
+  {
+    int fh = atoi(ent->d_name);
+    
+    if ((fh > top) && (fh != dirfd(dir)))
+      okay = posix_spawn_file_actions_addclose(actions,fh) == 0;
+  }
+  
+  closedir(dir);
+  return okay;
+#endif
+}
+
+/************************************************************************
+*
+* Hooks are started with posix_spawn(), which with the GNU C library
+* doesn't copy the page tables of this process like fork() does, so
+* starting one stays cheap however large the process is.  The hook gets
+* /dev/null for stdin, stdout and stderr, and no other descriptors but
+* those asked to be kept.
+*
+*************************************************************************/
+
+static pid_t hook_spawn(char const *tag,char const *argv[],int const keep[],size_t num)
 {
+  extern char                **environ;
+  posix_spawn_file_actions_t   actions;
+  pid_t                        child;
+  int                          rc;
+  
   assert(tag     != NULL);
   assert(argv    != NULL);
   assert(argv[0] != NULL);
+  assert((keep   != NULL) || (num == 0));
   
-  pid_t child = fork();
+  rc = posix_spawn_file_actions_init(&actions);
+  if (rc != 0)
+  {
+    syslog(LOG_ERR,"%s='%s' posix_spawn_file_actions_init()='%s'",tag,argv[0],strerror(rc));
+    return -1;
+  }
+  
+  if (
+          (posix_spawn_file_actions_addopen(&actions,STDIN_FILENO,"/dev/null",O_RDWR,0) != 0)
+       || (posix_spawn_file_actions_adddup2(&actions,STDIN_FILENO,STDOUT_FILENO)        != 0)
+       || (posix_spawn_file_actions_adddup2(&actions,STDIN_FILENO,STDERR_FILENO)        != 0)
+       || !hook_closes(&actions,keep,num)
+     )
+    rc = ENOMEM;
+  else
+    rc = posix_spawn(&child,argv[0],&actions,NULL,(char **)argv,environ);
+    
+  posix_spawn_file_actions_destroy(&actions);
+  
+  if (rc != 0)
+  {
+    syslog(LOG_ERR,"%s='%s' posix_spawn()='%s'",tag,argv[0],strerror(rc));
+    return -1;
+  }
+  
+  return child;
+}
+
+/************************************************************************/
+
+static bool hook_status(char const *tag,char const *program,int status)
+{
+  assert(tag     != NULL);
+  assert(program != NULL);
+  
+  if (WIFEXITED(status))
+  {
+    if (WEXITSTATUS(status) != 0)
+    {
+      syslog(LOG_ERR,"%s='%s' status=%d",tag,program,WEXITSTATUS(status));
+      return false;
+    }
+  }
+  else
+  {
+    syslog(LOG_ERR,"%s='%s' terminated='%s'",tag,program,strsignal(WTERMSIG(status)));
+    return false;
+  }
+  
+  return true;
+}
+
+/************************************************************************/
+
+static bool hook(char const *tag,char const *argv[],int const keep[],size_t num)
+{
+  int   status;
+  pid_t child = hook_spawn(tag,argv,keep,num);
   
   if (child == -1)
+    return false;
+    
+  if (waitpid(child,&status,0) != child)
+  {
+    syslog(LOG_ERR,"%s='%s' waitpid()='%s'",tag,argv[0],strerror(errno));
+    return false;
+  }
+  
+  return hook_status(tag,argv[0],status);
+}
+
+/************************************************************************/
+
+bool run_hook(char const *tag,char const *argv[])
+{
+  bool rc;
+  
+  stats_start(STAGE_HOOK);
+  rc = hook(tag,argv,NULL,0);
+  stats_stop(STAGE_HOOK);
+  return rc;
+}
+
+/************************************************************************/
+
+bool run_hook_fds(char const *tag,char const *argv[],int const keep[],size_t num)
+{
+  bool rc;
+  
+  stats_start(STAGE_HOOK);
+  rc = hook(tag,argv,keep,num);
+  stats_stop(STAGE_HOOK);
+  return rc;
+}
+
+/************************************************************************/
+
+static bool spool_sync(char const *spool)
+{
+  int dir = open(spool,O_RDONLY | O_DIRECTORY);
+  
+  if (dir == -1)
+  {
+    syslog(LOG_ERR,"%s: %s",spool,strerror(errno));
+    return false;
+  }
+  
+  fsync(dir);
+  close(dir);
+  return true;
+}
+
+/************************************************************************/
+
+static bool job_name(
+        char const *name,
+        long long  *when,
+        long       *nsec,
+        long       *pid,
+        unsigned   *attempts
+)
+{
+  int len = 0;
+  
+  assert(name     != NULL);
+  assert(when     != NULL);
+  assert(nsec     != NULL);
+  assert(pid      != NULL);
+  assert(attempts != NULL);
+  
+  if ((*name < '0') || (*name > '9'))
+    return false;
+  if (sscanf(name,"%lld.%ld.%ld.%u%n",when,nsec,pid,attempts,&len) != 4)
+    return false;
+  return name[len] == '\0';
+}
+
+/************************************************************************/
+
+bool queue_hook(char const *spool,char const *tag,char const *argv[])
+{
+  static unsigned  seq;
+  struct timespec  now;
+  char             tmp [FILENAME_MAX];
+  char             name[FILENAME_MAX];
+  FILE            *out;
+  int              fh;
+  bool             okay;
+  
+  assert(tag     != NULL);
+  assert(argv    != NULL);
+  assert(argv[0] != NULL);
+  
+  if (spool == NULL)
+    return run_hook(tag,argv);
+    
+  stats_start(STAGE_HOOK);
+  snprintf(tmp,sizeof(tmp),"%s/.tmp.%ld.%u",spool,(long)getpid(),seq++);
+  fh = open(tmp,O_WRONLY | O_CREAT | O_EXCL,0644);
+  if ((fh == -1) || ((out = fdopen(fh,"w")) == NULL))
+  {
+    syslog(LOG_ERR,"%s: %s",tmp,strerror(errno));
+    if (fh != -1)
+    {
+      close(fh);
+      remove(tmp);
+    }
+    stats_stop(STAGE_HOOK);
+    return false;
+  }
+  
+  fwrite(tag,1,strlen(tag) + 1,out);
+  for (size_t i = 0 ; argv[i] != NULL ; i++)
+    fwrite(argv[i],1,strlen(argv[i]) + 1,out);
+    
+  okay = (fflush(out) == 0) && (fsync(fh) == 0);
+  if (fclose(out) != 0)
+    okay = false;
+    
+  if (!okay)
+  {
+    syslog(LOG_ERR,"%s: %s",tmp,strerror(errno));
+    remove(tmp);
+    stats_stop(STAGE_HOOK);
+    return false;
+  }
+  
+  clock_gettime(CLOCK_REALTIME,&now);
+  snprintf(
+        name,
+        sizeof(name),
+        "%s/%010lld.%09ld.%ld.0",
+        spool,
+        (long long)now.tv_sec,
+        now.tv_nsec,
+        (long)getpid()
+  );
+  
+  if (rename(tmp,name) != 0)
+  {
+    syslog(LOG_ERR,"rename('%s','%s') = %s",tmp,name,strerror(errno));
+    remove(tmp);
+    stats_stop(STAGE_HOOK);
+    return false;
+  }
+  
+  okay = spool_sync(spool);
+  stats_stop(STAGE_HOOK);
+  return okay;
+}
+
+/************************************************************************/
+
+static bool job_start(char const *spool,struct job *job)
+{
+  char         path[FILENAME_MAX];
+  char         buffer[BUFSIZ + 1];
+  char const  *argv[JOB_ARGS + 1];
+  size_t       argc;
+  size_t       len;
+  size_t       i;
+  FILE        *in;
+  
+  assert(spool != NULL);
+  assert(job   != NULL);
+  
+  job->bad = false;
+  snprintf(job->tag,    sizeof(job->tag),    "%s","");
+  snprintf(job->program,sizeof(job->program),"%s","");
+  snprintf(path,sizeof(path),"%s/%s",spool,job->name);
+  in = fopen(path,"rb");
+  if (in == NULL)
+  {
+    syslog(LOG_ERR,"%s: %s",path,strerror(errno));
+    return false;
+  }
+  
+  len = fread(buffer,1,sizeof(buffer),in);
+  fclose(in);
+  
+  /*----------------------------------------------------------------------
+  ; The first string is the tag, then the program and its arguments, each
+  ; ending with a NUL.  We only ever queue short tags and a few arguments,
+  ; so a long tag, too many arguments or a job too big for the buffer means
+  ; a bad job, and running what's left of it would be worse than not
+  ; running it at all.
+  ;-----------------------------------------------------------------------*/
+  
+  if ((len == 0) || (len == sizeof(buffer)) || (buffer[len - 1] != '\0'))
+  {
+    syslog(LOG_ERR,"%s: bad job (%s)",path,len == sizeof(buffer) ? "too big" : "truncated");
+    job->bad = true;
+    return false;
+  }
+  
+  if ((size_t)snprintf(job->tag,sizeof(job->tag),"%s",buffer) >= sizeof(job->tag))
+  {
+    syslog(LOG_ERR,"%s: bad job (tag too long)",path);
+    job->bad = true;
+    return false;
+  }
+  
+  argc = 0;
+  
+  for (i = strlen(buffer) + 1 ; (i < len) && (argc < JOB_ARGS) ; i += strlen(&buffer[i]) + 1)
+    argv[argc++] = &buffer[i];
+  argv[argc] = NULL;
+  
+  if ((argc == 0) || (i < len))
   {
-    syslog(LOG_ERR,"%s='%s' fork()='%s'",tag,argv[0],strerror(errno));
+    syslog(LOG_ERR,"%s: bad job (%s)",path,argc == 0 ? "no program" : "too many arguments");
+    job->bad = true;
     return false;
   }
-  else if (child == 0)
-  {
-    extern char **environ;
-    int devnull = open("/dev/null",O_RDWR);
-    if (devnull == -1)
-      _Exit(EX_UNAVAILABLE);
-    if (dup2(devnull,STDIN_FILENO) == -1)
-      _Exit(EX_OSERR);
-    if (dup2(devnull,STDOUT_FILENO) == -1)
-      _Exit(EX_OSERR);
-    if (dup2(devnull,STDERR_FILENO) == -1)
-      _Exit(EX_OSERR);
-    for (int fh = STDERR_FILENO + 1 ; fh <= devnull ; fh++)
-      if (close(fh) == -1)
-        _Exit(EX_OSERR);
-    execve((char *)argv[0],(char **)argv,environ);
-    _Exit(EX_UNAVAILABLE);
+  
+  snprintf(job->program,sizeof(job->program),"%s",argv[0]);
+  job->pid = hook_spawn(job->tag,argv,NULL,0);
+  return job->pid != -1;
+}
+
+/************************************************************************/
+
+static void job_done(char const *spool,struct job *job,bool okay,size_t retries)
+{
+  char      path[FILENAME_MAX];
+  char      next[FILENAME_MAX + sizeof(".failed")];
+  long long when;
+  long      nsec;
+  long      pid;
+  unsigned  attempts;
+  
+  assert(spool != NULL);
+  assert(job   != NULL);
+  
+  job->pid = 0;
+  snprintf(path,sizeof(path),"%s/%s",spool,job->name);
+  
+  if (okay)
+  {
+    if (remove(path) != 0)
+      syslog(LOG_ERR,"%s: %s",path,strerror(errno));
+    return;
+  }
+  
+  if (!job_name(job->name,&when,&nsec,&pid,&attempts))
+    return;
+    
+  if (++attempts >= retries)
+  {
+    snprintf(next,sizeof(next),"%s.failed",path);
+    syslog(LOG_ERR,"%s='%s' giving up after %u attempts, see %s",job->tag,job->program,attempts,next);
   }
   else
   {
-    int status;
+    long long backoff = (long long)JOB_BACKOFF << (attempts - 1);
     
-    if (waitpid(child,&status,0) != child)
+    if ((attempts > 7) || (backoff > JOB_BACKOFF_MAX))
+      backoff = JOB_BACKOFF_MAX;
+      
+    snprintf(
+          next,
+          sizeof(next),
+          "%s/%010lld.%09ld.%ld.%u",
+          spool,
+          (long long)time(NULL) + backoff,
+          nsec,
+          pid,
+          attempts
+    );
+  }
+  
+  if (rename(path,next) != 0)
+    syslog(LOG_ERR,"rename('%s','%s') = %s",path,next,strerror(errno));
+}
+
+/************************************************************************/
+
+static int job_cmp(void const *left,void const *right)
+{
+  char const *const *l = left;
+  char const *const *r = right;
+  
+  return strcmp(*l,*r);
+}
+
+/************************************************************************/
+
+static size_t jobs_ready(char const *spool,char ***pnames)
+{
+  DIR            *dir;
+  struct dirent  *ent;
+  char          **names = NULL;
+  size_t          num   = 0;
+  size_t          max   = 0;
+  time_t          now   = time(NULL);
+  
+  assert(spool  != NULL);
+  assert(pnames != NULL);
+  
+  dir = opendir(spool);
+  if (dir == NULL)
+  {
+    syslog(LOG_ERR,"%s: %s",spool,strerror(errno));
+    *pnames = NULL;
+    return 0;
+  }
+  
+  while((ent = readdir(dir)) != NULL)
+  {
+    long long when;
+    long      nsec;
+    long      pid;
+    unsigned  attempts;
+    
+    if (!job_name(ent->d_name,&when,&nsec,&pid,&attempts) || (when > now))
+      continue;
+      
+    if (num == max)
     {
-      syslog(LOG_ERR,"%s='%s' waitpid()='%s'",tag,argv[0],strerror(errno));
-      return false;
+      char **n = realloc(names,(max + 16) * sizeof(char *));
+      if (n == NULL)
+        break;
+      names = n;
+      max  += 16;
     }
     
-    if (WIFEXITED(status))
+    names[num] = strdup(ent->d_name);
+    if (names[num] != NULL)
+      num++;
+  }
+  
+  closedir(dir);
+  if (num > 0)
+    qsort(names,num,sizeof(char *),job_cmp);
+  *pnames = names;
+  return num;
+}
+
+/************************************************************************/
+
+static void worker_stop(int sig)
+{
+  (void)sig;
+  m_stop = 1;
+}
+
+/************************************************************************/
+
+int run_hooks(char const *spool,size_t jobs,size_t retries,bool once)
+{
+  char              path[FILENAME_MAX];
+  struct sigaction  act;
+  struct job       *running;
+  size_t            active = 0;
+  int               lock;
+  
+  assert(spool != NULL);
+  
+  if (jobs == 0)
+    jobs = 1;
+  if (retries == 0)
+    retries = 1;
+    
+  /*----------------------------------------------------------------------
+  ; Two workers on one spool would end up running the same job twice, so
+  ; only one gets to run.
+  ;-----------------------------------------------------------------------*/
+  
+  snprintf(path,sizeof(path),"%s/.lock",spool);
+  lock = open(path,O_CREAT | O_RDWR,0644);
+  if (lock == -1)
+  {
+    syslog(LOG_ERR,"%s: %s",path,strerror(errno));
+    return EXIT_FAILURE;
+  }
+  
+  if (flock(lock,LOCK_EX | LOCK_NB) != 0)
+  {
+    syslog(LOG_ERR,"%s: worker already running",spool);
+    close(lock);
+    return EXIT_FAILURE;
+  }
+  
+  running = calloc(jobs,sizeof(struct job));
+  if (running == NULL)
+  {
+    syslog(LOG_ERR,"%s: %s",spool,strerror(errno));
+    close(lock);
+    return EXIT_FAILURE;
+  }
+  
+  memset(&act,0,sizeof(act));
+  sigemptyset(&act.sa_mask);
+  act.sa_handler = worker_stop;
+  sigaction(SIGTERM,&act,NULL);
+  sigaction(SIGINT, &act,NULL);
+  
+  /*----------------------------------------------------------------------
+  ; Once told to stop, no more jobs are started, but the running ones are
+  ; waited for so their outcome gets recorded.
+  ;-----------------------------------------------------------------------*/
+  
+  while(!m_stop || (active > 0))
+  {
+    pid_t  pid;
+    int    status;
+    char **names;
+    size_t num     = 0;
+    size_t started = 0;
+    
+    while((active > 0) && ((pid = waitpid(-1,&status,WNOHANG)) > 0))
     {
-      if (WEXITSTATUS(status) != 0)
+      for (size_t i = 0 ; i < jobs ; i++)
       {
-        syslog(LOG_ERR,"%s='%s' status=%d",tag,argv[0],WEXITSTATUS(status));
-        return false;
+        if (running[i].pid == pid)
+        {
+          job_done(spool,&running[i],hook_status(running[i].tag,running[i].program,status),retries);
+          active--;
+          break;
+        }
       }
     }
-    else
+    
+    if (!m_stop && (active < jobs))
     {
-      syslog(LOG_ERR,"%s='%s' terminated='%s'",tag,argv[0],strsignal(WTERMSIG(status)));
-      return false;
+      num = jobs_ready(spool,&names);
+      
+      for (size_t n = 0 ; (n < num) && (active < jobs) ; n++)
+      {
+        bool   busy = false;
+        size_t slot = jobs;
+        
+        for (size_t i = 0 ; i < jobs ; i++)
+        {
+          if (running[i].pid == 0)
+            slot = i;
+          else if (strcmp(running[i].name,names[n]) == 0)
+            busy = true;
+        }
+        
+        if (busy || (slot == jobs))
+          continue;
+          
+        snprintf(running[slot].name,sizeof(running[slot].name),"%s",names[n]);
+        if (job_start(spool,&running[slot]))
+        {
+          active++;
+          started++;
+        }
+        else
+          job_done(spool,&running[slot],false,running[slot].bad ? 1 : retries);
+      }
+      
+      for (size_t n = 0 ; n < num ; n++)
+        free(names[n]);
+      free(names);
     }
+    
+    if (once && (active == 0) && (started == 0))
+      break;
+      
+    sleep(1);
   }
   
-  return true;
+  free(running);
+  close(lock);
+  return EXIT_SUCCESS;
 }
 
 /************************************************************************/
@@ -0,0 +1,1302 @@
+/************************************************************************
+*
+* Copyright 2026 by Sean Conner.  All Rights Reserved.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*
+* Comments, questions and criticisms can be sent to: sean@conman.org
+*
+*************************************************************************/
+
+/*************************************************************************
+*
+* Full text search of the titles and bodies of entries (with the HTML
+* stripped out).  The index is kept in .search, in a form that can be used
+* as is once it's mapped into memory:
+*
+*       header
+*       entries         struct sentry[entries], in order
+*       terms           struct sterm[terms], sorted by name
+*       names           NUL terminated strings, referenced by the terms
+*       postings        for each term, the entries it appears in, each
+*                       as the difference from the previous one, seven
+*                       bits a byte, the high bit set on all but the last
+*
+* A lookup is then a binary search for each word of the query, and a merge
+* of the postings.  Building the index ("--reindex") means reading every
+* entry, so BlogEntryWrite() doesn't do that---it appends a line to the log
+* file .search.log instead:
+*
+*       YYYY/MM/DD.N TAB word word word ...
+*
+* which is checked along with the index.  A line for an entry replaces what
+* the index has for it (so an edited entry is found by what it says now),
+* and a later line replaces an earlier one.  Once the log grows past
+* SEARCH_LOGMAX bytes it's merged into the index, which only takes reading
+* the index and the log, not every entry, and cleared.
+*
+* A word is a run of letters, digits and any byte of a UTF-8 sequence,
+* folded to lower case.  Words of one character are skipped, and longer
+* ones are cut off at SEARCH_WORDMAX.  An entry has to have every word in
+* the query to match.  The index is in the byte order of the host; it's a
+* cache, not something to be copied around.
+*
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <syslog.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <cgilib8/htmltok.h>
+
+#include "search.h"
+#include "blogutil.h"
+#include "stats.h"
+
+#define SEARCH_INDEX    ".search"
+#define SEARCH_NEW      ".search.new"
+#define SEARCH_LOG      ".search.log"
+#define SEARCH_MAGIC    "mbsrch01"
+#define SEARCH_WORDMAX  32
+#define SEARCH_QUERYMAX 16
+#define SEARCH_LOGMAX   65536
+
+typedef bool (*word__f)(void *,char const *);
+
+struct header
+{
+  char     magic[8];
+  uint32_t entries;
+  uint32_t terms;
+  uint32_t names;       /* offset of names    */
+  uint32_t postings;    /* offset of postings */
+  uint32_t size;        /* size of the file   */
+  uint32_t pad;
+};
+
+struct sentry
+{
+  uint16_t year;
+  uint8_t  month;
+  uint8_t  day;
+  uint8_t  part;
+  uint8_t  pad[3];
+};
+
+struct sterm
+{
+  uint32_t name;        /* offset from the start of names    */
+  uint32_t post;        /* offset from the start of postings */
+  uint32_t count;
+};
+
+struct term
+{
+  char     *name;
+  uint32_t *post;
+  size_t    num;
+  size_t    max;
+};
+
+struct terms
+{
+  struct term *table;   /* open addressed, size a power of 2 */
+  size_t       size;
+  size_t       num;
+  uint32_t     current; /* entry being indexed               */
+};
+
+struct index
+{
+  void                *base;
+  size_t               size;
+  struct header const *header;
+  struct sentry const *entries;
+  struct sterm  const *terms;
+  char          const *names;
+  uint8_t       const *postings;
+};
+
+struct logent
+{
+  struct btm  when;
+  char const *words;
+  size_t      len;
+  size_t      seq;
+};
+
+struct query
+{
+  char   words[SEARCH_QUERYMAX][SEARCH_WORDMAX];
+  size_t num;
+};
+
+/*************************************************************************/
+
+static char const *entity_end(char const *text)
+{
+  char const *p;
+  
+  assert(text  != NULL);
+  assert(*text == '&');
+  
+  for (p = text + 1 ; isalnum((unsigned char)*p) || (*p == '#') ; p++)
+    ;
+    
+  return (*p == ';') && (p > text + 1) ? p : NULL;
+}
+
+/*************************************************************************/
+
+static void text_words(char const *text,word__f add,void *data)
+{
+  char   word[SEARCH_WORDMAX];
+  size_t len = 0;
+  
+  assert(text != NULL);
+  assert(add  != NULL);
+  
+  for ( ; ; text++)
+  {
+    unsigned char  c = *text;
+    char const    *end;
+    
+    /*---------------------------------------------------------------------
+    ; An entity like &mdash; is taken as the end of a word; it isn't part of
+    ; one.
+    ;----------------------------------------------------------------------*/
+    
+    if ((c == '&') && ((end = entity_end(text)) != NULL))
+    {
+      c    = ' ';
+      text = end;
+    }
+    
+    if ((c >= 0x80) || isalnum(c))
+    {
+      if (len < sizeof(word) - 1)
+        word[len++] = c < 0x80 ? tolower(c) : c;
+    }
+    else
+    {
+      if (len > 1)
+      {
+        word[len] = '\0';
+        (*add)(data,word);
+      }
+      
+      len = 0;
+      if (c == '\0')
+        break;
+    }
+  }
+}
+
+/*************************************************************************/
+
+static void html_words(char const *html,word__f add,void *data)
+{
+  FILE      *in;
+  HtmlToken  token;
+  int        t;
+  
+  assert(add != NULL);
+  
+  if ((html == NULL) || (*html == '\0'))
+    return;
+    
+  in = fmemopen((void *)html,strlen(html),"r");
+  if (in == NULL)
+    return;
+    
+  token = HtmlParseNew(in);
+  if (token != NULL)
+  {
+    while((t = HtmlParseNext(token)) != T_EOF)
+      if (t == T_STRING)
+        text_words(HtmlParseValue(token),add,data);
+    HtmlParseFree(token);
+  }
+  
+  fclose(in);
+}
+
+/*************************************************************************/
+
+static bool terms_grow(struct terms *terms)
+{
+  size_t       size = terms->size == 0 ? 1024 : terms->size * 2;
+  struct term *table;
+  
+  assert(terms != NULL);
+  
+  table = calloc(size,sizeof(struct term));
+  if (table == NULL)
+    return false;
+    
+  for (size_t i = 0 ; i < terms->size ; i++)
+  {
+    if (terms->table[i].name != NULL)
+    {
+      size_t h = hash_mem(HASH_INIT,terms->table[i].name,strlen(terms->table[i].name)) & (size - 1);
+      
+      while(table[h].name != NULL)
+        h = (h + 1) & (size - 1);
+      table[h] = terms->table[i];
+    }
+  }
+  
+  free(terms->table);
+  terms->table = table;
+  terms->size  = size;
+  return true;
+}
+
+/*************************************************************************/
+
+static bool terms_add(void *data,char const *word)
+{
+  struct terms *terms = data;
+  struct term  *term;
+  size_t        h;
+  
+  assert(data != NULL);
+  assert(word != NULL);
+  
+  if ((terms->num * 2 >= terms->size) && !terms_grow(terms))
+    return false;
+    
+  h = hash_mem(HASH_INIT,word,strlen(word)) & (terms->size - 1);
+  
+  while((terms->table[h].name != NULL) && (strcmp(terms->table[h].name,word) != 0))
+    h = (h + 1) & (terms->size - 1);
+    
+  term = &terms->table[h];
+  
+  if (term->name == NULL)
+  {
+    term->name = strdup(word);
+    if (term->name == NULL)
+      return false;
+    terms->num++;
+  }
+  
+  /*-----------------------------------------------------------------------
+  ; Entries are indexed one at a time, so a word seen again in the same
+  ; entry is the last one in the list.
+  ;------------------------------------------------------------------------*/
+  
+  if ((term->num > 0) && (term->post[term->num - 1] == terms->current))
+    return true;
+    
+  if (term->num == term->max)
+  {
+    size_t    max  = term->max == 0 ? 4 : term->max * 2;
+    uint32_t *post = realloc(term->post,max * sizeof(uint32_t));
+    
+    if (post == NULL)
+      return false;
+    term->post = post;
+    term->max  = max;
+  }
+  
+  term->post[term->num++] = terms->current;
+  return true;
+}
+
+/*************************************************************************/
+
+static void terms_free(struct terms *terms)
+{
+  assert(terms != NULL);
+  
+  for (size_t i = 0 ; i < terms->size ; i++)
+  {
+    free(terms->table[i].name);
+    free(terms->table[i].post);
+  }
+  
+  free(terms->table);
+}
+
+/*************************************************************************/
+
+static int term_cmp(void const *left,void const *right)
+{
+  struct term const *const *l = left;
+  struct term const *const *r = right;
+  
+  return strcmp((*l)->name,(*r)->name);
+}
+
+/*************************************************************************/
+
+static int post_cmp(void const *left,void const *right)
+{
+  uint32_t const *l = left;
+  uint32_t const *r = right;
+  
+  return *l < *r ? -1 : *l > *r ? 1 : 0;
+}
+
+/*************************************************************************/
+
+static size_t varint_size(uint32_t value)
+{
+  size_t size = 1;
+  
+  while(value >= 0x80)
+  {
+    value >>= 7;
+    size++;
+  }
+  
+  return size;
+}
+
+/*************************************************************************/
+
+static void varint_put(FILE *out,uint32_t value)
+{
+  assert(out != NULL);
+  
+  while(value >= 0x80)
+  {
+    putc((value & 0x7F) | 0x80,out);
+    value >>= 7;
+  }
+  
+  putc(value,out);
+}
+
+/*************************************************************************/
+
+static uint8_t const *varint_get(uint8_t const *p,uint8_t const *end,uint32_t *pvalue)
+{
+  uint32_t value = 0;
+  
+  assert(p      != NULL);
+  assert(end    != NULL);
+  assert(pvalue != NULL);
+  
+  for (unsigned int shift = 0 ; (p < end) && (shift < 32) ; shift += 7)
+  {
+    value |= (uint32_t)(*p & 0x7F) << shift;
+    if ((*p++ & 0x80) == 0)
+    {
+      *pvalue = value;
+      return p;
+    }
+  }
+  
+  return NULL;
+}
+
+/*************************************************************************/
+
+static bool index_write(struct terms *terms,struct sentry const *entries,size_t num)
+{
+  struct term   **list;
+  struct header   header;
+  size_t          nterms = 0;
+  size_t          names  = 0;
+  size_t          posts  = 0;
+  size_t          total;
+  FILE           *out;
+  
+  assert(terms != NULL);
+  assert((entries != NULL) || (num == 0));
+  
+  list = malloc((terms->num + 1) * sizeof(struct term *));
+  if (list == NULL)
+    return false;
+    
+  for (size_t i = 0 ; i < terms->size ; i++)
+  {
+    if (terms->table[i].name != NULL)
+    {
+      list[nterms++]  = &terms->table[i];
+      names          += strlen(terms->table[i].name) + 1;
+      
+      for (size_t j = 0 ; j < terms->table[i].num ; j++)
+        posts += varint_size(terms->table[i].post[j] - (j > 0 ? terms->table[i].post[j - 1] : 0));
+    }
+  }
+  
+  qsort(list,nterms,sizeof(struct term *),term_cmp);
+  
+  memset(&header,0,sizeof(header));
+  memcpy(header.magic,SEARCH_MAGIC,sizeof(header.magic));
+  
+  total = sizeof(struct header)
+        + num    * sizeof(struct sentry)
+        + nterms * sizeof(struct sterm);
+        
+  if (total + names + posts > UINT32_MAX)
+  {
+    syslog(LOG_ERR,"%s: index too large",SEARCH_INDEX);
+    free(list);
+    return false;
+  }
+  
+  header.entries  = num;
+  header.terms    = nterms;
+  header.names    = total;
+  header.postings = total + names;
+  header.size     = total + names + posts;
+  
+  out = stats_fopen(SEARCH_NEW,"w");
+  if (out == NULL)
+  {
+    syslog(LOG_ERR,"%s: %s",SEARCH_NEW,strerror(errno));
+    free(list);
+    return false;
+  }
+  
+  fwrite(&header,sizeof(header),1,out);
+  fwrite(entries,sizeof(struct sentry),num,out);
+  
+  names = 0;
+  posts = 0;
+  
+  for (size_t i = 0 ; i < nterms ; i++)
+  {
+    struct sterm term;
+    
+    term.name  = names;
+    term.post  = posts;
+    term.count = list[i]->num;
+    fwrite(&term,sizeof(term),1,out);
+    
+    names += strlen(list[i]->name) + 1;
+    for (size_t j = 0 ; j < list[i]->num ; j++)
+      posts += varint_size(list[i]->post[j] - (j > 0 ? list[i]->post[j - 1] : 0));
+  }
+  
+  for (size_t i = 0 ; i < nterms ; i++)
+    fwrite(list[i]->name,strlen(list[i]->name) + 1,1,out);
+    
+  for (size_t i = 0 ; i < nterms ; i++)
+    for (size_t j = 0 ; j < list[i]->num ; j++)
+      varint_put(out,list[i]->post[j] - (j > 0 ? list[i]->post[j - 1] : 0));
+      
+  free(list);
+  stats_written(header.size);
+  
+  if ((fclose(out) != 0) || (rename(SEARCH_NEW,SEARCH_INDEX) != 0))
+  {
+    syslog(LOG_ERR,"%s: %s",SEARCH_INDEX,strerror(errno));
+    remove(SEARCH_NEW);
+    return false;
+  }
+  
+  return true;
+}
+
+/*************************************************************************/
+
+bool search_exists(void)
+{
+  return stats_access(SEARCH_INDEX,F_OK) == 0;
+}
+
+/*************************************************************************/
+
+bool search_build(Blog *blog)
+{
+  struct terms   terms;
+  struct sentry *entries = NULL;
+  size_t         num     = 0;
+  size_t         max     = 0;
+  bool           okay    = true;
+  BlogCursor     cursor;
+  BlogEntry     *entry;
+  int            lock;
+  
+  assert(blog != NULL);
+  
+  /*-----------------------------------------------------------------------
+  ; The lock keeps new entries out while the index is built, so none are
+  ; lost when the log is cleared afterwards.
+  ;------------------------------------------------------------------------*/
+  
+  lock = BlogLock(blog);
+  memset(&terms,0,sizeof(terms));
+  BlogCursorInit(&cursor,blog,&blog->first,&blog->last,false);
+  
+  while(okay && ((entry = BlogCursorRead(&cursor)) != NULL))
+  {
+    if (num == max)
+    {
+      struct sentry *n;
+      
+      max = max == 0 ? 1024 : max * 2;
+      n   = realloc(entries,max * sizeof(struct sentry));
+      if (n == NULL)
+      {
+        BlogEntryFree(entry);
+        okay = false;
+        break;
+      }
+      entries = n;
+    }
+    
+    memset(&entries[num],0,sizeof(struct sentry));
+    entries[num].year  = entry->when.year;
+    entries[num].month = entry->when.month;
+    entries[num].day   = entry->when.day;
+    entries[num].part  = entry->when.part;
+    terms.current      = num++;
+    
+    html_words(entry->title,terms_add,&terms);
+    html_words(entry->body,terms_add,&terms);
+    BlogEntryFree(entry);
+  }
+  
+  if (okay)
+    okay = index_write(&terms,entries,num);
+  if (okay)
+    remove(SEARCH_LOG);
+    
+  terms_free(&terms);
+  free(entries);
+  BlogUnlock(blog,lock);
+  return okay;
+}
+
+/*************************************************************************/
+
+static bool index_map(struct index *index)
+{
+  struct stat          status;
+  struct header const *header;
+  int                  fh;
+  
+  assert(index != NULL);
+  
+  fh = open(SEARCH_INDEX,O_RDONLY);
+  if (fh == -1)
+    return false;
+    
+  if ((fstat(fh,&status) == -1) || ((size_t)status.st_size < sizeof(struct header)))
+  {
+    syslog(LOG_ERR,"%s: bad index",SEARCH_INDEX);
+    close(fh);
+    return false;
+  }
+  
+  index->size = status.st_size;
+  index->base = mmap(NULL,index->size,PROT_READ,MAP_SHARED,fh,0);
+  close(fh);
+  
+  if (index->base == MAP_FAILED)
+  {
+    syslog(LOG_ERR,"%s: %s",SEARCH_INDEX,strerror(errno));
+    return false;
+  }
+  
+  /*-----------------------------------------------------------------------
+  ; Check the layout before trusting any of the offsets in it.
+  ;------------------------------------------------------------------------*/
+  
+  header = index->base;
+  
+  if (
+          (memcmp(header->magic,SEARCH_MAGIC,sizeof(header->magic)) != 0)
+       || (header->size != index->size)
+       || (
+               header->names
+            != sizeof(struct header)
+               + (size_t)header->entries * sizeof(struct sentry)
+               + (size_t)header->terms   * sizeof(struct sterm)
+          )
+       || (header->postings < header->names)
+       || (header->postings > header->size)
+       || ((header->terms > 0) && ((char const *)index->base)[header->postings - 1] != '\0')
+     )
+  {
+    syslog(LOG_ERR,"%s: bad index",SEARCH_INDEX);
+    munmap(index->base,index->size);
+    return false;
+  }
+  
+  index->header   = header;
+  index->entries  = (struct sentry const *)(header + 1);
+  index->terms    = (struct sterm  const *)(index->entries + header->entries);
+  index->names    = (char          const *)index->base + header->names;
+  index->postings = (uint8_t       const *)index->base + header->postings;
+  return true;
+}
+
+/*************************************************************************/
+
+static struct sterm const *index_find(struct index const *index,char const *word)
+{
+  size_t low  = 0;
+  size_t high = index->header->terms;
+  
+  assert(index != NULL);
+  assert(word  != NULL);
+  
+  while(low < high)
+  {
+    size_t mid = low + (high - low) / 2;
+    int    rc;
+    
+    if (index->terms[mid].name >= index->header->postings - index->header->names)
+      return NULL;
+      
+    rc = strcmp(word,&index->names[index->terms[mid].name]);
+    if (rc == 0)
+      return &index->terms[mid];
+    else if (rc < 0)
+      high = mid;
+    else
+      low = mid + 1;
+  }
+  
+  return NULL;
+}
+
+/*************************************************************************/
+
+static int logent_cmp(void const *left,void const *right)
+{
+  struct logent const *l  = left;
+  struct logent const *r  = right;
+  int                  rc = btm_cmp(&l->when,&r->when);
+  
+  if (rc != 0)
+    return rc;
+  return l->seq < r->seq ? -1 : l->seq > r->seq ? 1 : 0;
+}
+
+/*************************************************************************/
+
+static char *log_read(struct logent **plog,size_t *pnum)
+{
+  struct stat    status;
+  struct logent *log  = NULL;
+  size_t         num  = 0;
+  size_t         keep = 0;
+  char          *text;
+  char          *line;
+  FILE          *in;
+  size_t         size;
+  
+  assert(plog != NULL);
+  assert(pnum != NULL);
+  
+  *plog = NULL;
+  *pnum = 0;
+  
+  if (stats_stat(SEARCH_LOG,&status) != 0)
+    return NULL;
+    
+  in = stats_fopen(SEARCH_LOG,"r");
+  if (in == NULL)
+    return NULL;
+    
+  text = malloc(status.st_size + 1);
+  if (text == NULL)
+  {
+    fclose(in);
+    return NULL;
+  }
+  
+  size = fread(text,1,status.st_size,in);
+  stats_read(size);
+  text[size] = '\0';
+  fclose(in);
+  
+  /*-----------------------------------------------------------------------
+  ; A line without a newline is still being written, so it's skipped.
+  ;------------------------------------------------------------------------*/
+  
+  for (line = text ; *line != '\0' ; )
+  {
+    char *eol = strchr(line,'\n');
+    char *tab;
+    
+    if (eol == NULL)
+      break;
+      
+    tab = memchr(line,'\t',eol - line);
+    
+    if (tab != NULL)
+    {
+      struct logent *n = realloc(log,(num + 1) * sizeof(struct logent));
+      
+      if (n == NULL)
+        break;
+      log = n;
+      
+      if (sscanf(line,"%d/%d/%d.%d",&log[num].when.year,&log[num].when.month,&log[num].when.day,&log[num].when.part) == 4)
+      {
+        log[num].words = tab + 1;
+        log[num].len   = eol - (tab + 1);
+        log[num].seq   = num;
+        num++;
+      }
+    }
+    
+    line = eol + 1;
+  }
+  
+  /*-----------------------------------------------------------------------
+  ; Sort by entry, and keep only the last line for each.
+  ;------------------------------------------------------------------------*/
+  
+  if (num > 0)
+  {
+    qsort(log,num,sizeof(struct logent),logent_cmp);
+    
+    for (size_t i = 0 ; i < num ; i++)
+      if ((i == num - 1) || (btm_cmp(&log[i].when,&log[i + 1].when) != 0))
+        log[keep++] = log[i];
+  }
+  
+  *plog = log;
+  *pnum = keep;
+  return text;
+}
+
+/*************************************************************************/
+
+static bool log_has_word(struct logent const *ent,char const *word)
+{
+  size_t      len = strlen(word);
+  char const *p   = ent->words;
+  char const *end = ent->words + ent->len;
+  
+  assert(ent  != NULL);
+  assert(word != NULL);
+  
+  while(p < end)
+  {
+    char const *sp = memchr(p,' ',end - p);
+    
+    if (sp == NULL)
+      sp = end;
+    if (((size_t)(sp - p) == len) && (memcmp(p,word,len) == 0))
+      return true;
+    p = sp + 1;
+  }
+  
+  return false;
+}
+
+/*************************************************************************/
+
+static bool log_has_entry(struct logent const *log,size_t num,struct btm const *when)
+{
+  size_t low  = 0;
+  size_t high = num;
+  
+  assert((log != NULL) || (num == 0));
+  assert(when != NULL);
+  
+  while(low < high)
+  {
+    size_t mid = low + (high - low) / 2;
+    int    rc  = btm_cmp(when,&log[mid].when);
+    
+    if (rc == 0)
+      return true;
+    else if (rc < 0)
+      high = mid;
+    else
+      low = mid + 1;
+  }
+  
+  return false;
+}
+
+/*************************************************************************/
+
+static bool index_merge(void)
+{
+  struct index    index;
+  struct terms    terms;
+  struct logent  *log;
+  size_t          lognum;
+  char           *logtext;
+  struct sentry  *entries;
+  uint32_t       *renum;
+  uint32_t       *lognew;
+  size_t          total;
+  size_t          num  = 0;
+  size_t          i    = 0;
+  size_t          l    = 0;
+  bool            okay = true;
+  
+  /*-----------------------------------------------------------------------
+  ; Fold the log into the index.  This only needs what's in the index and
+  ; the log, not the entries themselves, so it can be done as entries are
+  ; written.  The caller holds the lock on the blog.
+  ;------------------------------------------------------------------------*/
+  
+  if (!index_map(&index))
+    return false;
+    
+  logtext = log_read(&log,&lognum);
+  if (logtext == NULL)
+  {
+    munmap(index.base,index.size);
+    return false;
+  }
+  
+  total   = index.header->entries;
+  entries = malloc((total + lognum + 1) * sizeof(struct sentry));
+  renum   = malloc((total + 1)          * sizeof(uint32_t));
+  lognew  = malloc((lognum + 1)         * sizeof(uint32_t));
+  memset(&terms,0,sizeof(terms));
+  
+  if ((entries == NULL) || (renum == NULL) || (lognew == NULL))
+    okay = false;
+    
+  /*-----------------------------------------------------------------------
+  ; Both are in order, so merge the list of entries, noting where each one
+  ; ends up.  An entry in the log replaces the one in the index.
+  ;------------------------------------------------------------------------*/
+  
+  while(okay && ((i < total) || (l < lognum)))
+  {
+    int rc;
+    
+    if (i == total)
+      rc = 1;
+    else if (l == lognum)
+      rc = -1;
+    else
+    {
+      struct btm when;
+      
+      when.year  = index.entries[i].year;
+      when.month = index.entries[i].month;
+      when.day   = index.entries[i].day;
+      when.part  = index.entries[i].part;
+      rc         = btm_cmp(&when,&log[l].when);
+    }
+    
+    if (rc <= 0)
+    {
+      entries[num] = index.entries[i];
+      renum[i++]   = rc == 0 ? UINT32_MAX : num;
+      if (rc < 0)
+        num++;
+    }
+    
+    if (rc >= 0)
+    {
+      memset(&entries[num],0,sizeof(struct sentry));
+      entries[num].year  = log[l].when.year;
+      entries[num].month = log[l].when.month;
+      entries[num].day   = log[l].when.day;
+      entries[num].part  = log[l].when.part;
+      lognew[l++]        = num++;
+    }
+  }
+  
+  for (size_t t = 0 ; okay && (t < index.header->terms) ; t++)
+  {
+    struct sterm  const *term  = &index.terms[t];
+    uint8_t       const *p     = index.postings + term->post;
+    uint8_t       const *end   = (uint8_t const *)index.base + index.size;
+    uint32_t             entry = 0;
+    
+    if (
+         (term->name >= index.header->postings - index.header->names)
+         || (term->post >= index.size - index.header->postings)
+       )
+      continue;
+      
+    for (uint32_t j = 0 ; j < term->count ; j++)
+    {
+      uint32_t delta;
+      
+      p = varint_get(p,end,&delta);
+      if (p == NULL)
+        break;
+        
+      entry += delta;
+      if (entry >= total)
+        break;
+      if (renum[entry] == UINT32_MAX)
+        continue;
+        
+      terms.current = renum[entry];
+      if (!terms_add(&terms,&index.names[term->name]))
+      {
+        okay = false;
+        break;
+      }
+    }
+  }
+  
+  for (l = 0 ; okay && (l < lognum) ; l++)
+  {
+    char const *p   = log[l].words;
+    char const *end = log[l].words + log[l].len;
+    
+    terms.current = lognew[l];
+    
+    while(okay && (p < end))
+    {
+      char const *sp = memchr(p,' ',end - p);
+      char        word[SEARCH_WORDMAX];
+      
+      if (sp == NULL)
+        sp = end;
+        
+      if ((sp > p) && ((size_t)(sp - p) < sizeof(word)))
+      {
+        memcpy(word,p,sp - p);
+        word[sp - p] = '\0';
+        okay         = terms_add(&terms,word);
+      }
+      
+      p = sp + 1;
+    }
+  }
+  
+  /*-----------------------------------------------------------------------
+  ; An edited (or back dated) entry from the log can come before entries
+  ; from the index with the same word, so put the postings back in order.
+  ;------------------------------------------------------------------------*/
+  
+  for (size_t t = 0 ; okay && (t < terms.size) ; t++)
+  {
+    struct term *term = &terms.table[t];
+    
+    for (size_t j = 1 ; j < term->num ; j++)
+    {
+      if (term->post[j - 1] > term->post[j])
+      {
+        qsort(term->post,term->num,sizeof(uint32_t),post_cmp);
+        break;
+      }
+    }
+  }
+  
+  munmap(index.base,index.size);
+  
+  if (okay)
+    okay = index_write(&terms,entries,num);
+  if (okay)
+    remove(SEARCH_LOG);
+    
+  terms_free(&terms);
+  free(lognew);
+  free(renum);
+  free(entries);
+  free(log);
+  free(logtext);
+  return okay;
+}
+
+/*************************************************************************/
+
+void search_update(BlogEntry const *entry)
+{
+  struct terms  terms;
+  char         *line = NULL;
+  size_t        size = 0;
+  FILE         *out;
+  int           fh;
+  bool          merge = false;
+  
+  assert(entry != NULL);
+  
+  /*-----------------------------------------------------------------------
+  ; Without an index, there's nothing to update.  The entry will be picked
+  ; up when it's built.
+  ;------------------------------------------------------------------------*/
+  
+  if (stats_access(SEARCH_INDEX,F_OK) != 0)
+    return;
+    
+  memset(&terms,0,sizeof(terms));
+  html_words(entry->title,terms_add,&terms);
+  html_words(entry->body,terms_add,&terms);
+  
+  out = open_memstream(&line,&size);
+  if (out == NULL)
+  {
+    terms_free(&terms);
+    return;
+  }
+  
+  fprintf(
+           out,
+           "%d/%02d/%02d.%d\t",
+           entry->when.year,
+           entry->when.month,
+           entry->when.day,
+           entry->when.part
+         );
+         
+  for (size_t i = 0 ; i < terms.size ; i++)
+    if (terms.table[i].name != NULL)
+      fprintf(out,"%s ",terms.table[i].name);
+      
+  fputc('\n',out);
+  fclose(out);
+  terms_free(&terms);
+  
+  /*-----------------------------------------------------------------------
+  ; A single write() to a file opened for appending, so lines from different
+  ; processes don't get mixed up.
+  ;------------------------------------------------------------------------*/
+  
+  fh = open(SEARCH_LOG,O_WRONLY | O_APPEND | O_CREAT,0644);
+  if (fh == -1)
+    syslog(LOG_ERR,"%s: %s",SEARCH_LOG,strerror(errno));
+  else
+  {
+    struct stat status;
+    
+    if (write(fh,line,size) == -1)
+      syslog(LOG_ERR,"%s: %s",SEARCH_LOG,strerror(errno));
+    else
+      stats_written(size);
+      
+    if ((fstat(fh,&status) == 0) && (status.st_size > SEARCH_LOGMAX))
+      merge = true;
+    close(fh);
+  }
+  
+  free(line);
+  
+  if (merge)
+    index_merge();
+}
+
+/*************************************************************************/
+
+static size_t word_hits(
+        struct index  const *index,
+        struct logent const *log,
+        size_t               lognum,
+        char          const *word,
+        struct btm         **plist
+)
+{
+  struct sterm  const *term;
+  struct btm          *list;
+  size_t               max = lognum;
+  size_t               num = 0;
+  size_t               l   = 0;
+  
+  assert(index  != NULL);
+  assert(word   != NULL);
+  assert(plist  != NULL);
+  
+  term = index_find(index,word);
+  if ((term != NULL) && (term->post >= index->size - index->header->postings))
+    term = NULL;
+  if (term != NULL)
+    max += term->count;
+    
+  list = malloc((max + 1) * sizeof(struct btm));
+  if (list == NULL)
+  {
+    *plist = NULL;
+    return 0;
+  }
+  
+  /*-----------------------------------------------------------------------
+  ; Both the postings and the log are in order, so merge them as we go,
+  ; leaving out what the index has for any entry in the log.
+  ;------------------------------------------------------------------------*/
+  
+  if (term != NULL)
+  {
+    uint8_t const *p     = index->postings + term->post;
+    uint8_t const *end   = (uint8_t const *)index->base + index->size;
+    uint32_t       entry = 0;
+    
+    for (uint32_t i = 0 ; (p != NULL) && (i < term->count) ; i++)
+    {
+      struct btm when;
+      uint32_t   delta;
+      
+      p = varint_get(p,end,&delta);
+      if (p == NULL)
+        break;
+        
+      entry += delta;
+      if (entry >= index->header->entries)
+        break;
+        
+      when.year  = index->entries[entry].year;
+      when.month = index->entries[entry].month;
+      when.day   = index->entries[entry].day;
+      when.part  = index->entries[entry].part;
+      
+      if (log_has_entry(log,lognum,&when))
+        continue;
+        
+      for ( ; (l < lognum) && (btm_cmp(&log[l].when,&when) < 0) ; l++)
+        if (log_has_word(&log[l],word))
+          list[num++] = log[l].when;
+          
+      list[num++] = when;
+    }
+  }
+  
+  for ( ; l < lognum ; l++)
+    if (log_has_word(&log[l],word))
+      list[num++] = log[l].when;
+      
+  *plist = list;
+  return num;
+}
+
+/*************************************************************************/
+
+static bool query_add(void *data,char const *word)
+{
+  struct query *query = data;
+  
+  assert(data != NULL);
+  assert(word != NULL);
+  
+  for (size_t i = 0 ; i < query->num ; i++)
+    if (strcmp(query->words[i],word) == 0)
+      return true;
+      
+  if (query->num == SEARCH_QUERYMAX)
+    return false;
+    
+  strcpy(query->words[query->num++],word);
+  return true;
+}
+
+/*************************************************************************/
+
+bool search_query(Blog *blog,char const *text,struct btm **plist,size_t *pnum)
+{
+  struct index   index;
+  struct query   query;
+  struct logent *log;
+  size_t         lognum;
+  char          *logtext;
+  struct btm    *result = NULL;
+  size_t         num    = 0;
+  
+  assert(blog  != NULL);
+  assert(text  != NULL);
+  assert(plist != NULL);
+  assert(pnum  != NULL);
+  
+  (void)blog;
+  *plist = NULL;
+  *pnum  = 0;
+  
+  /*-----------------------------------------------------------------------
+  ; The log is read before the index is mapped.  Should it be merged in
+  ; between, the entries in it are found in both, which is harmless, where
+  ; the other way around they'd be missed.
+  ;------------------------------------------------------------------------*/
+  
+  logtext = log_read(&log,&lognum);
+  
+  if (!index_map(&index))
+  {
+    free(log);
+    free(logtext);
+    return false;
+  }
+  
+  query.num = 0;
+  text_words(text,query_add,&query);
+  
+  /*-----------------------------------------------------------------------
+  ; Intersect the hits for each word.  Both lists are in order, so it's a
+  ; simple merge.
+  ;------------------------------------------------------------------------*/
+  
+  for (size_t w = 0 ; w < query.num ; w++)
+  {
+    struct btm *hits;
+    size_t      hitnum = word_hits(&index,log,lognum,query.words[w],&hits);
+    
+    if (w == 0)
+    {
+      result = hits;
+      num    = hitnum;
+    }
+    else
+    {
+      size_t i = 0;
+      size_t j = 0;
+      size_t k = 0;
+      
+      while((i < num) && (j < hitnum))
+      {
+        int rc = btm_cmp(&result[i],&hits[j]);
+        
+        if (rc < 0)
+          i++;
+        else if (rc > 0)
+          j++;
+        else
+        {
+          result[k++] = result[i++];
+          j++;
+        }
+      }
+      
+      num = k;
+      free(hits);
+    }
+    
+    if (num == 0)
+      break;
+  }
+  
+  /*-----------------------------------------------------------------------
+  ; Newest first.
+  ;------------------------------------------------------------------------*/
+  
+  for (size_t i = 0 ; i < num / 2 ; i++)
+  {
+    struct btm tmp      = result[i];
+    result[i]           = result[num - 1 - i];
+    result[num - 1 - i] = tmp;
+  }
+  
+  free(log);
+  free(logtext);
+  munmap(index.base,index.size);
+  
+  *plist = result;
+  *pnum  = num;
+  return true;
+}
+
+/*************************************************************************/
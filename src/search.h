@@ -0,0 +1,38 @@
+/************************************************************************
+*
+* Copyright 2026 by Sean Conner.  All Rights Reserved.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*
+* Comments, questions and criticisms can be sent to: sean@conman.org
+*
+*************************************************************************/
+
+#ifndef I_A6FB887C_C22F_55E8_A767_4A8FC873D533
+#define I_A6FB887C_C22F_55E8_A767_4A8FC873D533
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "blog.h"
+
+/*********************************************************************/
+
+extern bool search_exists (void);
+extern bool search_build  (Blog *);
+extern void search_update (BlogEntry const *);
+extern bool search_query  (Blog *,char const *,struct btm **,size_t *);
+
+#endif
@@ -0,0 +1,461 @@
+/************************************************************************
+*
+* Copyright 2026 by Sean Conner.  All Rights Reserved.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*
+* Comments, questions and criticisms can be sent to: sean@conman.org
+*
+*************************************************************************/
+
+/*************************************************************************
+*
+* Where does the time go?  Each stage of handling a request keeps a total
+* of the time spent in it (by the monotonic clock), and how many times it
+* was entered.  Stages can nest (the body of an entry is rendered in the
+* middle of a template), and a stage can be re-entered (templates include
+* templates) in which case only the outermost call is timed.
+*
+* Along with the time, the number of files opened, the number of stat()s
+* (and access()s, which cost about the same), and the bytes read and
+* written are counted.  This is done through the wrappers at the end of
+* this file, as used by the storage and callback layers.
+*
+* Timing is cheap, so it's always done.  The record is only written out if
+* the environment variable BLOG_STATS, or the "stats" configuration option,
+* is set---to "syslog" to log it, otherwise it's the name of a file to
+* append it to (a relative name is relative to the basedir of the blog).
+*
+* Counting allocations is not so cheap, so it's only done in a debug build
+* (make CFLAGS="-g -DALLOC_STATS").  Then malloc() and friends are wrapped
+* to count allocations and bytes per stage (the innermost one running at
+* the time, or "other" if none).  The peak for a stage is the most the heap
+* grew while it ran (nested stages included) over what was in use when it
+* started; the peak for the request as a whole is the most it ever held.
+* This relies upon the GNU C library exporting __libc_malloc() and company.
+*
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <assert.h>
+
+#include <syslog.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#ifdef ALLOC_STATS
+#  include <malloc.h>
+#endif
+
+#include "stats.h"
+
+struct stage
+{
+  struct timespec start;
+  unsigned long   depth;
+  unsigned long   count;
+  long long       usec;
+  stage__e        outer;  /* stage running when this one started */
+};
+
+struct alloc
+{
+  unsigned long count;
+  unsigned long bytes;
+  size_t        base;   /* heap in use when the stage started */
+  size_t        peak;   /* most the heap grew over base       */
+};
+
+static char const *const m_names[STAGE_MAX + 1] =
+{
+  "config",
+  "tumbler",
+  "read",
+  "template",
+  "body",
+  "hook",
+  "output",
+  "other",    /* allocations outside of any stage */
+};
+
+static struct timespec  m_start;
+static struct stage     m_stages[STAGE_MAX];
+static char            *m_output;
+static bool             m_summary;
+static char             m_label[256];
+static unsigned long    m_opens;
+static unsigned long    m_stats;
+static unsigned long    m_read;
+static unsigned long    m_written;
+static stage__e         m_current = STAGE_MAX;
+static struct alloc     m_allocs[STAGE_MAX + 1];
+
+#ifdef ALLOC_STATS
+static size_t           m_inuse;
+static size_t           m_peak;
+#endif
+
+/*************************************************************************/
+
+static long long elapsed(struct timespec const *start)
+{
+  struct timespec now;
+  
+  assert(start != NULL);
+  
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return (now.tv_sec  - start->tv_sec)  * 1000000LL
+       + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+/*************************************************************************/
+
+void stats_init(char const *label)
+{
+  assert(label != NULL);
+  
+  clock_gettime(CLOCK_MONOTONIC,&m_start);
+  snprintf(m_label,sizeof(m_label),"%s",label);
+  stats_output(getenv("BLOG_STATS"));
+}
+
+/*************************************************************************/
+
+void stats_output(char const *output)
+{
+  /*----------------------------------------------------------------------
+  ; The first one set wins, so the environment overrides the configuration.
+  ;-----------------------------------------------------------------------*/
+  
+  if ((m_output == NULL) && (output != NULL) && (*output != '\0'))
+    m_output = strdup(output);
+}
+
+/*************************************************************************/
+
+void stats_summary(void)
+{
+  m_summary = true;
+}
+
+/*************************************************************************/
+
+void stats_start(stage__e stage)
+{
+  assert(stage < STAGE_MAX);
+  
+  if (m_stages[stage].depth++ == 0)
+  {
+    m_stages[stage].count++;
+    m_stages[stage].outer = m_current;
+    m_current             = stage;
+#ifdef ALLOC_STATS
+    m_allocs[stage].base  = m_inuse;
+#endif
+    clock_gettime(CLOCK_MONOTONIC,&m_stages[stage].start);
+  }
+}
+
+/*************************************************************************/
+
+void stats_stop(stage__e stage)
+{
+  assert(stage                 <  STAGE_MAX);
+  assert(m_stages[stage].depth >  0);
+  
+  if (--m_stages[stage].depth == 0)
+  {
+    m_stages[stage].usec += elapsed(&m_stages[stage].start);
+    m_current             = m_stages[stage].outer;
+  }
+}
+
+/*************************************************************************/
+
+void stats_report(void)
+{
+  char      buffer[BUFSIZ];
+  size_t    len;
+  long long total = elapsed(&m_start);
+  
+  if (m_summary)
+  {
+    fprintf(stderr,"%-10s %10s %8s\n","stage","usec","count");
+    for (size_t i = 0 ; i < STAGE_MAX ; i++)
+      fprintf(stderr,"%-10s %10lld %8lu\n",m_names[i],m_stages[i].usec,m_stages[i].count);
+    fprintf(stderr,"%-10s %10lld\n\n","total",total);
+    fprintf(stderr,"%-10s %10lu\n","opens",m_opens);
+    fprintf(stderr,"%-10s %10lu\n","stats",m_stats);
+    fprintf(stderr,"%-10s %10lu\n","read",m_read);
+    fprintf(stderr,"%-10s %10lu\n","written",m_written);
+    
+#ifdef ALLOC_STATS
+    fprintf(stderr,"\n%-10s %10s %10s %10s\n","stage","allocs","bytes","peak");
+    for (size_t i = 0 ; i <= STAGE_MAX ; i++)
+      fprintf(stderr,"%-10s %10lu %10lu %10zu\n",m_names[i],m_allocs[i].count,m_allocs[i].bytes,m_allocs[i].peak);
+    fprintf(stderr,"%-10s %10s %10s %10zu\n","total","","",m_peak);
+#endif
+  }
+  
+  if (m_output == NULL)
+    return;
+    
+  /*----------------------------------------------------------------------
+  ; One line per request:
+  ;
+  ;     request="..." total=<usec> <stage>=<usec>/<count> ...
+  ;             open=<n> stat=<n> read=<bytes> written=<bytes>
+  ;-----------------------------------------------------------------------*/
+  
+  len = snprintf(buffer,sizeof(buffer),"request=\"%s\" total=%lld",m_label,total);
+  
+  for (size_t i = 0 ; (i < STAGE_MAX) && (len < sizeof(buffer)) ; i++)
+    len += snprintf(
+                     &buffer[len],
+                     sizeof(buffer) - len,
+                     " %s=%lld/%lu",
+                     m_names[i],
+                     m_stages[i].usec,
+                     m_stages[i].count
+                   );
+                   
+  if (len < sizeof(buffer))
+    len += snprintf(
+                     &buffer[len],
+                     sizeof(buffer) - len,
+                     " open=%lu stat=%lu read=%lu written=%lu",
+                     m_opens,
+                     m_stats,
+                     m_read,
+                     m_written
+                   );
+                   
+#ifdef ALLOC_STATS
+  /*----------------------------------------------------------------------
+  ; followed by <stage>.alloc=<count>/<bytes>/<peak> ... peak=<bytes>
+  ;-----------------------------------------------------------------------*/
+  
+  for (size_t i = 0 ; (i <= STAGE_MAX) && (len < sizeof(buffer)) ; i++)
+    if (m_allocs[i].count > 0)
+      len += snprintf(
+                       &buffer[len],
+                       sizeof(buffer) - len,
+                       " %s.alloc=%lu/%lu/%zu",
+                       m_names[i],
+                       m_allocs[i].count,
+                       m_allocs[i].bytes,
+                       m_allocs[i].peak
+                     );
+                     
+  if (len < sizeof(buffer))
+    len += snprintf(&buffer[len],sizeof(buffer) - len," peak=%zu",m_peak);
+#endif
+
+  if (len >= sizeof(buffer) - 1)
+    len = sizeof(buffer) - 2;
+    
+  if (strcmp(m_output,"syslog") == 0)
+  {
+    buffer[len] = '\0';
+    syslog(LOG_INFO,"%s",buffer);
+  }
+  else
+  {
+    /*--------------------------------------------------------------------
+    ; A single write() to a file opened for appending keeps the records
+    ; from concurrent requests from interleaving.
+    ;---------------------------------------------------------------------*/
+    
+    int fh = open(m_output,O_WRONLY | O_APPEND | O_CREAT,0644);
+    
+    if (fh == -1)
+      syslog(LOG_ERR,"%s: %s",m_output,strerror(errno));
+    else
+    {
+      buffer[len++] = '\n';
+      if (write(fh,buffer,len) == -1)
+        syslog(LOG_ERR,"%s: %s",m_output,strerror(errno));
+      close(fh);
+    }
+  }
+}
+
+/*************************************************************************/
+
+FILE *stats_fopen(char const *name,char const *mode)
+{
+  assert(name != NULL);
+  assert(mode != NULL);
+  
+  m_opens++;
+  return fopen(name,mode);
+}
+
+/*************************************************************************/
+
+int stats_stat(char const *name,struct stat *status)
+{
+  assert(name   != NULL);
+  assert(status != NULL);
+  
+  m_stats++;
+  return stat(name,status);
+}
+
+/*************************************************************************/
+
+int stats_access(char const *name,int mode)
+{
+  assert(name != NULL);
+  
+  m_stats++;
+  return access(name,mode);
+}
+
+/*************************************************************************/
+
+void stats_read(size_t bytes)
+{
+  m_read += bytes;
+}
+
+/*************************************************************************/
+
+void stats_written(size_t bytes)
+{
+  m_written += bytes;
+}
+
+/*************************************************************************/
+
+void stats_allocated(unsigned long *count,unsigned long *bytes)
+{
+  assert(count != NULL);
+  assert(bytes != NULL);
+  
+  *count = 0;
+  *bytes = 0;
+  
+  for (size_t i = 0 ; i <= STAGE_MAX ; i++)
+  {
+    *count += m_allocs[i].count;
+    *bytes += m_allocs[i].bytes;
+  }
+}
+
+/*************************************************************************/
+
+#ifdef ALLOC_STATS
+
+extern void *__libc_malloc  (size_t);
+extern void *__libc_calloc  (size_t,size_t);
+extern void *__libc_realloc (void *,size_t);
+extern void  __libc_free    (void *);
+
+/*************************************************************************/
+
+static void alloc_add(void *ptr,size_t size)
+{
+  if (ptr != NULL)
+  {
+    struct alloc *alloc = &m_allocs[m_current];
+    
+    alloc->count++;
+    alloc->bytes += size;
+    m_inuse      += malloc_usable_size(ptr);
+    
+    if (m_inuse > m_peak)
+      m_peak = m_inuse;
+      
+    /*--------------------------------------------------------------------
+    ; Every stage running counts towards its own peak, not just the
+    ; innermost one the allocation is charged to.
+    ;---------------------------------------------------------------------*/
+    
+    for (size_t i = 0 ; i < STAGE_MAX ; i++)
+      if (
+           (m_stages[i].depth > 0)
+           && (m_inuse > m_allocs[i].base)
+           && (m_inuse - m_allocs[i].base > m_allocs[i].peak)
+         )
+        m_allocs[i].peak = m_inuse - m_allocs[i].base;
+  }
+}
+
+/*************************************************************************/
+
+static void alloc_sub(void *ptr)
+{
+  /*----------------------------------------------------------------------
+  ; Memory from memalign() and the like isn't counted going in, so don't let
+  ; it wrap the count coming out.
+  ;-----------------------------------------------------------------------*/
+  
+  if (ptr != NULL)
+  {
+    size_t size = malloc_usable_size(ptr);
+    m_inuse = size < m_inuse ? m_inuse - size : 0;
+  }
+}
+
+/*************************************************************************/
+
+void *malloc(size_t size)
+{
+  void *ptr = __libc_malloc(size);
+  alloc_add(ptr,size);
+  return ptr;
+}
+
+/*************************************************************************/
+
+void *calloc(size_t nmemb,size_t size)
+{
+  void *ptr = __libc_calloc(nmemb,size);
+  alloc_add(ptr,nmemb * size);
+  return ptr;
+}
+
+/*************************************************************************/
+
+void *realloc(void *old,size_t size)
+{
+  size_t  oldsize = old != NULL ? malloc_usable_size(old) : 0;
+  void   *ptr     = __libc_realloc(old,size);
+  
+  if ((ptr == NULL) && (size > 0))
+    return NULL;
+    
+  m_inuse = oldsize < m_inuse ? m_inuse - oldsize : 0;
+  alloc_add(ptr,size);
+  return ptr;
+}
+
+/*************************************************************************/
+
+void free(void *ptr)
+{
+  alloc_sub(ptr);
+  __libc_free(ptr);
+}
+
+/*************************************************************************/
+
+#endif
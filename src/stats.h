@@ -0,0 +1,56 @@
+/************************************************************************
+*
+* Copyright 2026 by Sean Conner.  All Rights Reserved.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*
+* Comments, questions and criticisms can be sent to: sean@conman.org
+*
+*************************************************************************/
+
+#ifndef I_35451E6E_7610_5FC5_BEE4_531A1D38B284
+#define I_35451E6E_7610_5FC5_BEE4_531A1D38B284
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+typedef enum stage__e
+{
+  STAGE_CONFIG,         /* BlogNew()                      */
+  STAGE_TUMBLER,        /* tumbler_new(), thisday_new()   */
+  STAGE_READ,           /* BlogEntryRead()                */
+  STAGE_TEMPLATE,       /* generic_cb()                   */
+  STAGE_BODY,           /* cb_entry_body()                */
+  STAGE_HOOK,           /* run_hook()                     */
+  STAGE_OUTPUT,         /* flushing generated output      */
+  STAGE_MAX
+} stage__e;
+
+/*********************************************************************/
+
+extern void  stats_init      (char const *);
+extern void  stats_output    (char const *);
+extern void  stats_summary   (void);
+extern void  stats_start     (stage__e);
+extern void  stats_stop      (stage__e);
+extern void  stats_report    (void);
+extern FILE *stats_fopen     (char const *,char const *);
+extern int   stats_stat      (char const *,struct stat *);
+extern int   stats_access    (char const *,int);
+extern void  stats_read      (size_t);
+extern void  stats_written   (size_t);
+extern void  stats_allocated (unsigned long *,unsigned long *);
+
+#endif
@@ -0,0 +1,332 @@
+/************************************************************************
+*
+* Copyright 2026 by Sean Conner.  All Rights Reserved.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*
+* Comments, questions and criticisms can be sent to: sean@conman.org
+*
+*************************************************************************/
+
+/*************************************************************************
+*
+* Request counting across CGI processes.  Since each request is its own
+* process, the counters live in a small file that every process maps in.
+* The file is a fixed size hash table of slots, each counting requests for
+* a single key (a client address or a route) over a fixed window of time.
+* Everything is done with atomic operations, no locking, so the counts are
+* approximate under contention, which is fine for what we use them for.
+*
+* This is all configured through the environment (like BLOG_CONFIG) since
+* it's checked before the configuration file is even loaded:
+*
+*       BLOG_THROTTLE           file with the counters; if not set, there
+*                               is no throttling
+*       BLOG_THROTTLE_WINDOW    length of window, in seconds (60)
+*       BLOG_THROTTLE_CLIENT    max requests per client per window (0)
+*       BLOG_THROTTLE_ROUTE     max requests per route per window (0)
+*
+* A limit of 0 means no limit.
+*
+*************************************************************************/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <assert.h>
+
+#include <syslog.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "throttle.h"
+#include "blogutil.h"
+
+#define THROTTLE_SLOTS  1024
+#define THROTTLE_PROBE     8
+#define THROTTLE_NAME     48
+
+struct slot
+{
+  uint64_t key;
+  uint32_t window;
+  uint32_t count;
+  char     name[THROTTLE_NAME];
+};
+
+/*************************************************************************/
+
+static unsigned long env_number(char const *name,unsigned long def)
+{
+  char const *value = getenv(name);
+  
+  assert(name != NULL);
+  
+  if ((value == NULL) || (*value == '\0'))
+    return def;
+  return strtoul(value,NULL,10);
+}
+
+/*************************************************************************/
+
+static struct slot *table_map(void)
+{
+  char const  *fname = getenv("BLOG_THROTTLE");
+  struct stat  status;
+  void        *table;
+  int          fh;
+  
+  if ((fname == NULL) || (*fname == '\0'))
+    return NULL;
+    
+  fh = open(fname,O_RDWR | O_CREAT,0600);
+  if (fh == -1)
+  {
+    syslog(LOG_ERR,"%s: %s",fname,strerror(errno));
+    return NULL;
+  }
+  
+  /*-----------------------------------------------------------------------
+  ; A new file is extended with zeros, which is an empty table.  Every
+  ; process extends it to the same size, so racing on this is harmless.
+  ;------------------------------------------------------------------------*/
+  
+  if (
+       (fstat(fh,&status) == -1)
+       || (
+            ((size_t)status.st_size < THROTTLE_SLOTS * sizeof(struct slot))
+            && (ftruncate(fh,THROTTLE_SLOTS * sizeof(struct slot)) == -1)
+          )
+     )
+  {
+    syslog(LOG_ERR,"%s: %s",fname,strerror(errno));
+    close(fh);
+    return NULL;
+  }
+  
+  table = mmap(NULL,THROTTLE_SLOTS * sizeof(struct slot),PROT_READ | PROT_WRITE,MAP_SHARED,fh,0);
+  close(fh);
+  
+  if (table == MAP_FAILED)
+  {
+    syslog(LOG_ERR,"%s: %s",fname,strerror(errno));
+    return NULL;
+  }
+  
+  return table;
+}
+
+/*************************************************************************/
+
+static bool claim(struct slot *s,uint64_t k,uint64_t key,char const *name,uint32_t window)
+{
+  assert(s    != NULL);
+  assert(name != NULL);
+  
+  if (!__atomic_compare_exchange_n(&s->key,&k,key,false,__ATOMIC_ACQ_REL,__ATOMIC_ACQUIRE))
+    return k == key;
+    
+  strncpy(s->name,name,THROTTLE_NAME - 1);
+  s->name[THROTTLE_NAME - 1] = '\0';
+  __atomic_store_n(&s->count,0,__ATOMIC_RELEASE);
+  __atomic_store_n(&s->window,window,__ATOMIC_RELEASE);
+  return true;
+}
+
+/*************************************************************************/
+
+static uint32_t bump(struct slot *table,char const *name,uint32_t window)
+{
+  struct slot *slot     = NULL;
+  struct slot *oldest   = NULL;
+  uint64_t     key;
+  uint64_t     oldkey   = 0;
+  uint32_t     oldwin   = 0;
+  uint32_t     oldcount = 0;
+  uint32_t     seen;
+  
+  assert(table != NULL);
+  assert(name  != NULL);
+  
+  key = hash_mem(HASH_INIT,name,strlen(name));
+  if (key == 0)
+    key = 1;
+    
+  /*-----------------------------------------------------------------------
+  ; Look for the key in a few slots.  A slot that is empty, or hasn't been
+  ; touched since before the previous window, can be claimed.  Failing that,
+  ; the least used of the slots looked at is taken over, as a full table
+  ; means a flood of clients, and that's just when counting matters.
+  ;------------------------------------------------------------------------*/
+  
+  for (size_t i = 0 ; i < THROTTLE_PROBE ; i++)
+  {
+    struct slot *s = &table[(key + i) % THROTTLE_SLOTS];
+    uint64_t     k = __atomic_load_n(&s->key,__ATOMIC_ACQUIRE);
+    
+    if (k == key)
+    {
+      slot = s;
+      break;
+    }
+    
+    seen = __atomic_load_n(&s->window,__ATOMIC_RELAXED);
+    if ((k == 0) || (seen + 1 < window))
+    {
+      if (claim(s,k,key,name,window))
+      {
+        slot = s;
+        break;
+      }
+    }
+    else
+    {
+      uint32_t count = __atomic_load_n(&s->count,__ATOMIC_RELAXED);
+      
+      if (
+           (oldest == NULL)
+           || (seen < oldwin)
+           || ((seen == oldwin) && (count < oldcount))
+         )
+      {
+        oldest   = s;
+        oldkey   = k;
+        oldwin   = seen;
+        oldcount = count;
+      }
+    }
+  }
+  
+  if ((slot == NULL) && (oldest != NULL) && claim(oldest,oldkey,key,name,window))
+    slot = oldest;
+    
+  /*-----------------------------------------------------------------------
+  ; If another process beat us to every slot, count it as over the limit,
+  ; rather than let it through uncounted.
+  ;------------------------------------------------------------------------*/
+  
+  if (slot == NULL)
+    return UINT32_MAX;
+    
+  seen = __atomic_load_n(&slot->window,__ATOMIC_ACQUIRE);
+  if (seen != window)
+    if (__atomic_compare_exchange_n(&slot->window,&seen,window,false,__ATOMIC_ACQ_REL,__ATOMIC_ACQUIRE))
+      __atomic_store_n(&slot->count,0,__ATOMIC_RELEASE);
+      
+  return __atomic_add_fetch(&slot->count,1,__ATOMIC_ACQ_REL);
+}
+
+/*************************************************************************/
+
+throttle__e throttle_check(char const *client,char const *route,unsigned int *retry)
+{
+  struct slot   *table;
+  unsigned long  length;
+  unsigned long  maxclient;
+  unsigned long  maxroute;
+  time_t         now;
+  uint32_t       window;
+  char           name[THROTTLE_NAME];
+  throttle__e    rc = THROTTLE_OKAY;
+  
+  assert(route != NULL);
+  assert(retry != NULL);
+  
+  maxclient = env_number("BLOG_THROTTLE_CLIENT",0);
+  maxroute  = env_number("BLOG_THROTTLE_ROUTE",0);
+  
+  if ((maxclient == 0) && (maxroute == 0))
+    return THROTTLE_OKAY;
+    
+  table = table_map();
+  if (table == NULL)
+    return THROTTLE_OKAY;
+    
+  length = env_number("BLOG_THROTTLE_WINDOW",60);
+  if (length == 0)
+    length = 1;
+    
+  now    = time(NULL);
+  window = now / length;
+  *retry = length - (now % length);
+  
+  if ((maxclient > 0) && (client != NULL))
+  {
+    snprintf(name,sizeof(name),"client %s",client);
+    if (bump(table,name,window) > maxclient)
+      rc = THROTTLE_CLIENT;
+  }
+  
+  if ((rc == THROTTLE_OKAY) && (maxroute > 0))
+  {
+    snprintf(name,sizeof(name),"route %s",route);
+    if (bump(table,name,window) > maxroute)
+      rc = THROTTLE_ROUTE;
+  }
+  
+  munmap(table,THROTTLE_SLOTS * sizeof(struct slot));
+  return rc;
+}
+
+/*************************************************************************/
+
+int throttle_dump(FILE *out)
+{
+  struct slot   *table;
+  unsigned long  length;
+  uint32_t       window;
+  
+  assert(out != NULL);
+  
+  table = table_map();
+  if (table == NULL)
+    return EXIT_FAILURE;
+    
+  length = env_number("BLOG_THROTTLE_WINDOW",60);
+  if (length == 0)
+    length = 1;
+  window = time(NULL) / length;
+  
+  /*----------------------------------------------------------------------
+  ; Output the current and previous window, one slot per line, as
+  ;
+  ;     <window start (time_t)> <count> <name>
+  ;-----------------------------------------------------------------------*/
+  
+  for (size_t i = 0 ; i < THROTTLE_SLOTS ; i++)
+  {
+    uint64_t key  = __atomic_load_n(&table[i].key,__ATOMIC_ACQUIRE);
+    uint32_t seen = __atomic_load_n(&table[i].window,__ATOMIC_ACQUIRE);
+    
+    if ((key != 0) && (seen + 1 >= window))
+      fprintf(
+               out,
+               "%lu %lu %.*s\n",
+               (unsigned long)seen * length,
+               (unsigned long)__atomic_load_n(&table[i].count,__ATOMIC_ACQUIRE),
+               THROTTLE_NAME,
+               table[i].name
+             );
+  }
+  
+  munmap(table,THROTTLE_SLOTS * sizeof(struct slot));
+  return EXIT_SUCCESS;
+}
+
+/*************************************************************************/
@@ -0,0 +1,40 @@
+/************************************************************************
+*
+* Copyright 2026 by Sean Conner.  All Rights Reserved.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*
+* Comments, questions and criticisms can be sent to: sean@conman.org
+*
+*************************************************************************/
+
+#ifndef I_032C4115_2DD3_5810_B717_355401DAC55B
+#define I_032C4115_2DD3_5810_B717_355401DAC55B
+
+#include <stdio.h>
+
+typedef enum throttle__e
+{
+  THROTTLE_OKAY,
+  THROTTLE_CLIENT,      /* client over its limit -> 429 */
+  THROTTLE_ROUTE,       /* route over its limit  -> 503 */
+} throttle__e;
+
+/*********************************************************************/
+
+extern throttle__e throttle_check (char const *,char const *,unsigned int *);
+extern int         throttle_dump  (FILE *);
+
+#endif
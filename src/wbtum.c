@@ -213,7 +213,10 @@ bool tumbler_new(
     
   text++;
   if (*text == '\0')
-    return tum->redirect |= true;
+  {
+    tum->redirect |= true;
+    return check_dates(tum,first,last);
+  }
     
   /*-------------------------------------------------
   ; parse month
@@ -244,7 +247,10 @@ bool tumbler_new(
   text++;
   
   if (*text == '\0')
-    return tum->redirect |= true;
+  {
+    tum->redirect |= true;
+    return check_dates(tum,first,last);
+  }
     
   /*--------------------
   ; parse day
@@ -268,7 +274,10 @@ bool tumbler_new(
   if (*text == '/')
   {
     if (text[1] == '\0')
-      return tum->redirect |= true;
+    {
+      tum->redirect |= true;
+      return check_dates(tum,first,last);
+    }
     else
       goto tumbler_new_file;
   }
@@ -483,10 +492,18 @@ tumbler_new_calculate:
     }
     else
     {
+      if (u2.val > 12) return false;
+      if (u3.val > 31) return false;
+      
+      tum->redirect |= (u2.len == 1)
+                    || (u3.len == 1)
+                    ;
+                    
       tum->stop.year  = u1.val;
       tum->stop.month = u2.val;
       tum->stop.day   = u3.val;
       tum->stop.part  = ENTRY_MAX;
+      tum->ustop      = UNIT_DAY;
       return check_dates(tum,first,last);
     }
   }
@@ -526,6 +543,7 @@ tumbler_new_calculate:
       
       if (u1.val >= first->year)
       {
+        if (u2.val > 12) return false;
         tum->redirect   |= (u2.len == 1);
         tum->stop.year   = u1.val;
         tum->stop.month  = u2.val;